@@ -1,9 +1,10 @@
 #include "bus.h"
 
-Bus::Bus(olc::PixelGameEngine* system)
+Bus::Bus()
 {
-	this->system = system;
 	running = false;
+
+	pages = std::make_unique<PAGE[]>(PAGES);
 }
 
 Bus::~Bus()
@@ -16,6 +17,28 @@ void Bus::AddDevice(std::shared_ptr<BusDevice> busDevice)
 	busDevices.push_back(busDevice);
 }
 
+void Bus::MapPages(uint32_t startAddress, uint32_t endAddress, uint8_t* read, uint8_t* write, BusDevice* busDevice)
+{
+	// Page aligned regions only, read / write pointers advance one page at a time
+
+	for (uint32_t page = startAddress >> PAGE_BITS; page <= (endAddress >> PAGE_BITS); page++)
+	{
+		pages[page].read = read;
+		pages[page].write = write;
+		pages[page].device = busDevice;
+
+		if (read != nullptr)
+			read += PAGE_SIZE;
+		if (write != nullptr)
+			write += PAGE_SIZE;
+	}
+}
+
+void Bus::UnmapPages(uint32_t startAddress, uint32_t endAddress)
+{
+	MapPages(startAddress, endAddress, nullptr, nullptr, nullptr);
+}
+
 std::shared_ptr<uint1_t> Bus::CreateLine1Bit(std::string name, uint1_t value)
 {
 	std::shared_ptr<uint1_t> valuePtr = std::make_shared<uint1_t>(value);
@@ -77,6 +100,17 @@ void Bus::Write(uint32_t address, uint8_t data)
 	std::cout << std::hex << std::setw(6) << std::setfill('0') << address << ", ";
 	std::cout << std::hex << std::setw(2) << std::setfill('0') << unsigned(data) << ")" << std::endl;*/
 
+	const PAGE& page = pages[(address >> PAGE_BITS) & (PAGES - 1)];
+
+	if (page.write != nullptr)
+	{
+		page.write[address & PAGE_MASK] = data;
+		return;
+	}
+
+	if (page.device != nullptr)
+		return page.device->Write(address, data);
+
 	for (auto const& busDevice : busDevices)
 	{
 		if (busDevice->ValidWrite(address))
@@ -86,6 +120,14 @@ void Bus::Write(uint32_t address, uint8_t data)
 
 uint8_t Bus::Read(uint32_t address)
 {
+	const PAGE& page = pages[(address >> PAGE_BITS) & (PAGES - 1)];
+
+	if (page.read != nullptr)
+		return page.read[address & PAGE_MASK];
+
+	if (page.device != nullptr)
+		return page.device->Read(address);
+
 	for (const auto& busDevice : busDevices)
 	{
 		if (busDevice->ValidRead(address))
@@ -99,6 +141,103 @@ uint8_t Bus::Read(uint32_t address)
 	return 0xc8;
 }
 
+bool Bus::Passive(uint32_t address)
+{
+	// Reading the address cannot change any state: memory behind a direct pointer, or a page not
+	// mapped to a register device (ROM and RAM are found by the device search)
+
+	const PAGE& page = pages[(address >> PAGE_BITS) & (PAGES - 1)];
+
+	return page.read != nullptr || page.device == nullptr;
+}
+
+bool Bus::Peek(uint32_t address, uint8_t& data)
+{
+	// A read with no side effects and no failure message, false for register devices and for
+	// addresses nothing answers
+
+	if (!Passive(address))
+		return false;
+
+	const PAGE& page = pages[(address >> PAGE_BITS) & (PAGES - 1)];
+
+	if (page.read != nullptr)
+	{
+		data = page.read[address & PAGE_MASK];
+		return true;
+	}
+
+	for (const auto& busDevice : busDevices)
+	{
+		if (busDevice->ValidRead(address))
+		{
+			data = busDevice->Read(address);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Bus::SaveState(State& state)
+{
+	// Every line by name and width, the devices save their own state
+
+	state.Begin("BUS ");
+
+	state.Put32((uint32_t)(lines1Bit.size() + lines8Bit.size() + lines16Bit.size() + lines32Bit.size()));
+
+	auto put = [&](const std::string& name, uint8_t width, uint32_t value)
+	{
+		state.Put8((uint8_t)name.size());
+		state.PutBytes(name.data(), name.size());
+		state.Put8(width);
+		state.Put32(value);
+	};
+
+	for (auto const& line : lines1Bit)
+		put(line.first, 1, *line.second);
+	for (auto const& line : lines8Bit)
+		put(line.first, 8, *line.second);
+	for (auto const& line : lines16Bit)
+		put(line.first, 16, *line.second);
+	for (auto const& line : lines32Bit)
+		put(line.first, 32, *line.second);
+
+	state.End();
+}
+
+bool Bus::LoadState(State& state)
+{
+	// Lines the bus does not have are skipped
+
+	if (!state.Find("BUS "))
+		return false;
+
+	uint32_t count = state.Get32();
+
+	for (uint32_t i = 0; i < count && !state.GetFailed(); i++)
+	{
+		std::string name(state.Get8(), ' ');
+
+		state.GetBytes(&name[0], name.size());
+
+		uint8_t width = state.Get8();
+		uint32_t value = state.Get32();
+
+		if (width == 1 && lines1Bit.count(name))
+			*lines1Bit[name] = (uint1_t)value;
+		else if (width == 8 && lines8Bit.count(name))
+			*lines8Bit[name] = (uint8_t)value;
+		else if (width == 16 && lines16Bit.count(name))
+			*lines16Bit[name] = (uint16_t)value;
+		else if (width == 32 && lines32Bit.count(name))
+			*lines32Bit[name] = value;
+	}
+
+	return !state.GetFailed();
+}
+
 void Bus::Run()
 {
 	uint32_t address = 0x00000000;
@@ -150,7 +289,7 @@ void Bus::Stop()
 }
 
 
-void Bus::Debug()
+std::string Bus::Debug()
 {
 	using namespace std;
 
@@ -230,11 +369,5 @@ void Bus::Debug()
 		col = 0;
 	}
 
-	system->DrawString(9, 9 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 7 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(9, 7 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 9 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 8 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(9, 8 + (0 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(8, 8 + (0 * 8), stringStream.str(), olc::WHITE, 1);
+	return stringStream.str();
 }
@@ -8,8 +8,10 @@
 #include <unordered_map>
 #include <string>
 #include <bitSet>
+#include <thread>
+#include <chrono>
 
-#include "olcPixelGameEngine.h"
+#include "state.h"
 
 typedef unsigned char uint1_t;
 
@@ -31,11 +33,23 @@ public:
 	typedef std::shared_ptr<uint16_t> Line16Bit;
 	typedef std::shared_ptr<uint32_t> Line32Bit;
 
+	static const uint32_t PAGE_BITS = 12;
+	static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+	static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+	static const uint32_t PAGES = 1 << (24 - PAGE_BITS);
+
+	typedef struct
+	{
+		uint8_t* read;			// direct read pointer, nullptr to go through device
+		uint8_t* write;			// direct write pointer, nullptr to go through device
+		BusDevice* device;		// device handling accesses without a direct pointer
+	} PAGE;
+
 private:
-	olc::PixelGameEngine* system;
 	bool running;
 
 	std::vector<std::shared_ptr<BusDevice>> busDevices;
+	std::unique_ptr<PAGE[]> pages;
 	std::map<std::string, Line1Bit> lines1Bit;
 	std::map<std::string, Line8Bit> lines8Bit;
 	std::map<std::string, Line16Bit> lines16Bit;
@@ -47,11 +61,14 @@ private:
 	Bus::Line1Bit RWB;
 
 public:
-	Bus(olc::PixelGameEngine* system);
+	Bus();
 	~Bus();
 
 	void AddDevice(std::shared_ptr<BusDevice> busDevice);
 
+	void MapPages(uint32_t startAddress, uint32_t endAddress, uint8_t* read, uint8_t* write, BusDevice* busDevice);
+	void UnmapPages(uint32_t startAddress, uint32_t endAddress);
+
 	Line1Bit CreateLine1Bit(std::string name, uint1_t value);
 	Line1Bit AttachLine1Bit(std::string name);
 	Line8Bit CreateLine8Bit(std::string name, uint8_t value);
@@ -63,10 +80,15 @@ public:
 
 	void Write(uint32_t address, uint8_t data);
 	uint8_t Read(uint32_t address);
+	bool Passive(uint32_t address);
+	bool Peek(uint32_t address, uint8_t& data);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
 
 	void Run();
 	void Start();
 	void Stop();
 
-	void Debug();
+	std::string Debug();
 };
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "capture.h"
+
+static std::array<uint32_t, 256> BuildCrcTable()
+{
+	std::array<uint32_t, 256> table;
+
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+
+		table[n] = c;
+	}
+
+	return table;
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t length, uint32_t crc = 0xffffffff)
+{
+	static const std::array<uint32_t, 256> crc_table = BuildCrcTable();
+
+	for (size_t i = 0; i < length; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+static void PutBig32(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+static void PutChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t length)
+{
+	PutBig32(out, (uint32_t)length);
+
+	size_t start = out.size();
+
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + length);
+
+	PutBig32(out, Crc32(&out[start], length + 4) ^ 0xffffffff);
+}
+
+Capture::Capture(uint32_t width, uint32_t height, FORMAT format, std::string path, POLICY policy, uint32_t queue_size)
+{
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	this->policy = policy;
+	this->path = path;
+
+	for (uint32_t i = 0; i < std::max(1u, queue_size); i++)
+	{
+		buffers.push_back(std::make_unique<uint32_t[]>(width * height));
+		free_buffers.push_back(i);
+	}
+
+	frames_submitted = 0;
+	frames_written = 0;
+	frames_dropped = 0;
+	failed = false;
+
+	if (format == FORMAT::RAW || format == FORMAT::Y4M)
+	{
+		stream.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+
+		if (!stream.is_open())
+			Fail("cannot open " + path);
+		else if (format == FORMAT::Y4M)
+			stream << "YUV4MPEG2 W" << width << " H" << height << " F" << FRAME_RATE << ":1 Ip A1:1 C444\n";
+	}
+
+	running = true;
+	writer = std::thread(&Capture::Run, this);
+}
+
+Capture::~Capture()
+{
+	Close();
+}
+
+bool Capture::Close()
+{
+	// Everything queued is still written before the writer stops, returns false when any of it
+	// could not be
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+
+	queued.notify_all();
+
+	if (writer.joinable())
+		writer.join();
+
+	if (stream.is_open())
+	{
+		stream.close();
+
+		if (stream.fail())
+			Fail("cannot write " + path);
+	}
+
+	return !GetFailed();
+}
+
+void Capture::Fail(std::string message)
+{
+	// Only the first failure is reported
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!failed)
+		std::cout << "Capture : " << message << std::endl;
+
+	failed = true;
+}
+
+Capture::FORMAT Capture::FormatFromPath(std::string path)
+{
+	std::string extension = path.substr(path.find_last_of('.') + 1);
+
+	if (extension == "y4m")
+		return FORMAT::Y4M;
+
+	if (extension == "png")
+		return FORMAT::PNG;
+
+	return FORMAT::RAW;
+}
+
+bool Capture::Submit(const uint32_t* frame)
+{
+	uint32_t buffer;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (free_buffers.empty())
+		{
+			if (policy == POLICY::DROP)
+			{
+				++frames_dropped;
+				++frames_submitted;
+				return false;
+			}
+
+			released.wait(lock, [&] { return !free_buffers.empty(); });
+		}
+
+		buffer = free_buffers.back();
+		free_buffers.pop_back();
+	}
+
+	// The copy happens outside the lock, the buffer belongs to this thread until it is queued
+
+	memcpy(buffers[buffer].get(), frame, width * height * sizeof(uint32_t));
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		queue.push_back({ buffer, frames_submitted++ });
+	}
+
+	queued.notify_one();
+
+	return true;
+}
+
+void Capture::Run()
+{
+	while (true)
+	{
+		QUEUED next;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			queued.wait(lock, [&] { return !queue.empty() || !running; });
+
+			if (queue.empty())
+				return;
+
+			next = queue.front();
+			queue.pop_front();
+		}
+
+		Encode(buffers[next.buffer].get(), next.number);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			free_buffers.push_back(next.buffer);
+			++frames_written;
+		}
+
+		released.notify_one();
+	}
+}
+
+void Capture::Encode(const uint32_t* frame, uint64_t number)
+{
+	// Nothing more is encoded once the output failed
+
+	if (GetFailed())
+		return;
+
+	switch (format)
+	{
+	case FORMAT::RAW:
+		if (!stream.write((const char*)frame, width * height * sizeof(uint32_t)))
+			Fail("cannot write " + path);
+		break;
+	case FORMAT::Y4M:
+		EncodeY4M(frame);
+
+		if (!stream.write((const char*)encoded.data(), encoded.size()))
+			Fail("cannot write " + path);
+		break;
+	case FORMAT::PNG:
+	{
+		std::ostringstream name;
+		std::string stem = path.substr(0, path.find_last_of('.'));
+
+		name << stem << "_" << std::setw(6) << std::setfill('0') << number << ".png";
+
+		EncodePNG(frame);
+
+		std::ofstream file(name.str(), std::ios::binary | std::ios::out | std::ios::trunc);
+
+		file.write((const char*)encoded.data(), encoded.size());
+		file.close();
+
+		if (file.fail())
+			Fail("cannot write " + name.str());
+		break;
+	}
+	}
+}
+
+void Capture::EncodeY4M(const uint32_t* frame)
+{
+	// BT.601 studio range, full resolution chroma
+
+	const char header[] = "FRAME\n";
+	uint32_t pixels = width * height;
+
+	encoded.resize((sizeof(header) - 1) + (pixels * 3));
+	memcpy(encoded.data(), header, sizeof(header) - 1);
+
+	uint8_t* y_plane = &encoded[sizeof(header) - 1];
+	uint8_t* u_plane = y_plane + pixels;
+	uint8_t* v_plane = u_plane + pixels;
+
+	for (uint32_t i = 0; i < pixels; i++)
+	{
+		int32_t r = frame[i] & 0xff;
+		int32_t g = (frame[i] >> 8) & 0xff;
+		int32_t b = (frame[i] >> 16) & 0xff;
+
+		y_plane[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		u_plane[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		v_plane[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+void Capture::EncodePNG(const uint32_t* frame)
+{
+	// 8 bit RGBA, no filtering, zlib stream of stored deflate blocks: no compressor dependency and
+	// the writer thread stays far ahead of 60 fps
+
+	const uint32_t row_size = 1 + (width * 4);
+	const uint32_t block_size = 0xffff;
+
+	std::vector<uint8_t> raw(row_size * height);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		raw[y * row_size] = 0x00;
+		memcpy(&raw[(y * row_size) + 1], &frame[y * width], width * 4);
+	}
+
+	std::vector<uint8_t> zlib;
+
+	zlib.reserve(raw.size() + ((raw.size() / block_size) + 1) * 5 + 6);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+
+	for (size_t offset = 0; offset < raw.size(); offset += block_size)
+	{
+		uint16_t length = (uint16_t)std::min<size_t>(block_size, raw.size() - offset);
+
+		zlib.push_back((offset + length >= raw.size()) ? 0x01 : 0x00);
+		zlib.push_back(length & 0xff);
+		zlib.push_back(length >> 8);
+		zlib.push_back(~length & 0xff);
+		zlib.push_back((~length >> 8) & 0xff);
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+	}
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+
+	for (size_t i = 0; i < raw.size(); i++)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	PutBig32(zlib, (b << 16) | a);
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a };
+	std::vector<uint8_t> header;
+
+	PutBig32(header, width);
+	PutBig32(header, height);
+	header.push_back(8);		// bit depth
+	header.push_back(6);		// RGBA
+	header.push_back(0);		// deflate
+	header.push_back(0);		// adaptive filtering
+	header.push_back(0);		// not interlaced
+
+	encoded.assign(signature, signature + sizeof(signature));
+
+	PutChunk(encoded, "IHDR", header.data(), header.size());
+	PutChunk(encoded, "IDAT", zlib.data(), zlib.size());
+	PutChunk(encoded, "IEND", nullptr, 0);
+}
+
+uint64_t Capture::GetSubmitted()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames_submitted;
+}
+
+uint64_t Capture::GetWritten()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames_written;
+}
+
+uint64_t Capture::GetDropped()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames_dropped;
+}
+
+bool Capture::GetFailed()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return failed;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Copies finished frames (olc::Pixel layout) into pooled buffers and encodes them on a writer thread,
+// so the emulation only ever pays for one memcpy per frame. An output that cannot be opened or
+// written marks the capture failed, Close tells whether everything was written.
+
+class Capture
+{
+public:
+	typedef std::shared_ptr<Capture> SharedPtr;
+
+	enum class FORMAT
+	{
+		RAW = 0,	// one file of packed RGBA frames
+		Y4M = 1,	// one YUV4MPEG2 4:4:4 file
+		PNG = 2,	// one file per frame, path_000000.png, ...
+	};
+
+	enum class POLICY
+	{
+		DROP = 0,	// a frame arriving to a full queue is dropped
+		STALL = 1,	// a frame arriving to a full queue waits for the writer
+	};
+
+	static const uint32_t QUEUE_SIZE = 8;
+	static const uint32_t FRAME_RATE = 60;
+
+	typedef struct
+	{
+		uint32_t buffer;		// index into buffers
+		uint64_t number;		// frame number since the capture started
+	} QUEUED;
+
+private:
+	uint32_t width;
+	uint32_t height;
+	FORMAT format;
+	POLICY policy;
+	std::string path;
+
+	std::vector<std::unique_ptr<uint32_t[]>> buffers;
+	std::vector<uint32_t> free_buffers;
+	std::deque<QUEUED> queue;
+
+	std::mutex mutex;
+	std::condition_variable queued;
+	std::condition_variable released;
+	std::thread writer;
+	bool running;
+	bool failed;
+
+	uint64_t frames_submitted;
+	uint64_t frames_written;
+	uint64_t frames_dropped;
+
+	std::ofstream stream;
+	std::vector<uint8_t> encoded;
+
+	void Run();
+	void Fail(std::string message);
+	void Encode(const uint32_t* frame, uint64_t number);
+	void EncodeY4M(const uint32_t* frame);
+	void EncodePNG(const uint32_t* frame);
+
+public:
+	Capture(uint32_t width, uint32_t height, FORMAT format, std::string path, POLICY policy = POLICY::DROP, uint32_t queue_size = QUEUE_SIZE);
+	~Capture();
+
+	static FORMAT FormatFromPath(std::string path);
+
+	bool Submit(const uint32_t* frame);
+	bool Close();
+
+	uint64_t GetSubmitted();
+	uint64_t GetWritten();
+	uint64_t GetDropped();
+	bool GetFailed();
+};
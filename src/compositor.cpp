@@ -0,0 +1,546 @@
+#include "compositor.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COMPOSITOR_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define COMPOSITOR_TARGET(isa)
+#else
+#define COMPOSITOR_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+static const uint32_t VECTOR = 16;	// pixels per vector fetch
+static const uint64_t COVERED = ~0ull;
+
+static uint64_t FillBlockScalar(const Compositor::LAYERROW& layer, uint32_t pixel_x, uint64_t coverage, uint8_t* indices)
+{
+	for (uint32_t i = 0; i < Compositor::BLOCK_WIDTH; i++)
+	{
+		if (!(coverage & (1ull << i)))
+		{
+			uint8_t pixel_lookup = layer.source[(pixel_x >> 16) & (Compositor::ROW_WIDTH - 1)];
+
+			if (pixel_lookup != 0x00)
+			{
+				indices[i] = pixel_lookup;
+				coverage |= 1ull << i;
+			}
+		}
+
+		pixel_x += layer.pixel_x_scale;
+	}
+
+	return coverage;
+}
+
+static inline uint32_t Coordinate(uint32_t position, uint32_t size, bool clamp)
+{
+	if (!clamp)
+		return (position >> 16) & (size - 1);
+
+	int32_t coordinate = (int32_t)position >> 16;
+
+	return (uint32_t)std::min<int32_t>(std::max<int32_t>(coordinate, 0), (int32_t)size - 1);
+}
+
+static inline uint8_t SampleTile(const Compositor::LAYERAFFINE& layer, uint32_t pixel_x, uint32_t pixel_y)
+{
+	// Entry: pattern in bits 0-9, flip x bit 10, flip y bit 11, upper nibble of the colour in bits 12-15
+
+	uint32_t fine_mask = (1 << layer.tile_shift) - 1;
+	uint16_t entry = layer.tile_map[(pixel_y >> layer.tile_shift) * Compositor::MAP_WIDTH + (pixel_x >> layer.tile_shift)];
+	uint32_t tile = (entry & 0x03ff) & (layer.tile_count - 1);
+	uint32_t fine_x = (pixel_x & fine_mask) ^ ((entry & 0x0400) ? fine_mask : 0);
+	uint32_t fine_y = (pixel_y & fine_mask) ^ ((entry & 0x0800) ? fine_mask : 0);
+	uint8_t pixel = layer.source[(((tile << layer.tile_shift) + fine_y) << layer.tile_shift) + fine_x];
+
+	return pixel ? (((entry & 0xf000) >> 8) | pixel) : 0x00;
+}
+
+static void SampleRowScalar(const Compositor::LAYERAFFINE& layer, uint8_t* row, uint32_t width)
+{
+	uint32_t size = layer.tile_map ? (Compositor::MAP_WIDTH << layer.tile_shift) : Compositor::ROW_WIDTH;
+	uint32_t pixel_x = layer.pixel_x;
+	uint32_t pixel_y = layer.pixel_y;
+
+	for (uint32_t i = 0; i < width; i++)
+	{
+		uint32_t source_x = Coordinate(pixel_x, size, layer.clamp);
+		uint32_t source_y = Coordinate(pixel_y, size, layer.clamp);
+
+		row[i] = layer.tile_map ? SampleTile(layer, source_x, source_y) : layer.source[source_y * Compositor::ROW_WIDTH + source_x];
+
+		pixel_x += layer.pixel_x_step;
+		pixel_y += layer.pixel_y_step;
+	}
+}
+
+static void ResolveRowScalar(const uint8_t* indices, const uint32_t* lut, uint32_t* row, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++)
+		row[x] = lut[indices[x]];
+}
+
+#ifdef COMPOSITOR_X86
+
+// Unscaled layers whose fetch does not wrap at the row edge are read as 16 contiguous bytes
+
+COMPOSITOR_TARGET("sse4.1")
+static inline bool FetchContiguous(const Compositor::LAYERROW& layer, uint32_t pixel_x, __m128i& indices)
+{
+	uint32_t offset = (pixel_x >> 16) & (Compositor::ROW_WIDTH - 1);
+
+	if (layer.pixel_x_scale != 0x10000 || offset + VECTOR > Compositor::ROW_WIDTH)
+		return false;
+
+	indices = _mm_loadu_si128((const __m128i*)&layer.source[offset]);
+
+	return true;
+}
+
+COMPOSITOR_TARGET("sse4.1")
+static inline __m128i FetchSSE41(const Compositor::LAYERROW& layer, uint32_t pixel_x)
+{
+	__m128i indices;
+
+	if (FetchContiguous(layer, pixel_x, indices))
+		return indices;
+
+	alignas(16) uint8_t fetched[VECTOR];
+
+	for (uint32_t i = 0; i < VECTOR; i++)
+	{
+		fetched[i] = layer.source[(pixel_x >> 16) & (Compositor::ROW_WIDTH - 1)];
+		pixel_x += layer.pixel_x_scale;
+	}
+
+	return _mm_load_si128((const __m128i*)fetched);
+}
+
+COMPOSITOR_TARGET("avx2")
+static inline __m128i FetchAVX2(const Compositor::LAYERROW& layer, uint32_t pixel_x)
+{
+	__m128i indices;
+
+	if (FetchContiguous(layer, pixel_x, indices))
+		return indices;
+
+	const __m256i mask_x = _mm256_set1_epi32(Compositor::ROW_WIDTH - 1);
+	const __m256i mask_byte = _mm256_set1_epi32(0xff);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	__m256i x_0 = _mm256_add_epi32(_mm256_set1_epi32(pixel_x), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(layer.pixel_x_scale)));
+	__m256i x_1 = _mm256_add_epi32(x_0, _mm256_set1_epi32(layer.pixel_x_scale * 8));
+
+	__m256i offset_0 = _mm256_and_si256(_mm256_srli_epi32(x_0, 16), mask_x);
+	__m256i offset_1 = _mm256_and_si256(_mm256_srli_epi32(x_1, 16), mask_x);
+
+	// 32 bit gathers of byte addresses, the top three bytes are masked off (source rows are padded)
+
+	__m256i fetched_0 = _mm256_and_si256(_mm256_i32gather_epi32((const int*)layer.source, offset_0, 1), mask_byte);
+	__m256i fetched_1 = _mm256_and_si256(_mm256_i32gather_epi32((const int*)layer.source, offset_1, 1), mask_byte);
+
+	__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(fetched_0, fetched_1), _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+}
+
+// Only lanes still transparent (index 0) take the new layer, covered vectors are not fetched at all
+
+#define COMPOSITOR_FILL_BLOCK(FETCH) \
+	const __m128i zero = _mm_setzero_si128(); \
+	for (uint32_t i = 0; i < Compositor::BLOCK_WIDTH; i += VECTOR) \
+	{ \
+		if (((coverage >> i) & 0xffff) != 0xffff) \
+		{ \
+			__m128i current = _mm_loadu_si128((const __m128i*)&indices[i]); \
+			__m128i empty = _mm_cmpeq_epi8(current, zero); \
+			current = _mm_or_si128(current, _mm_and_si128(empty, FETCH(layer, pixel_x))); \
+			_mm_storeu_si128((__m128i*)&indices[i], current); \
+			coverage |= (uint64_t)(~_mm_movemask_epi8(_mm_cmpeq_epi8(current, zero)) & 0xffff) << i; \
+		} \
+		pixel_x += layer.pixel_x_scale * VECTOR; \
+	} \
+	return coverage;
+
+COMPOSITOR_TARGET("sse4.1")
+static uint64_t FillBlockSSE41(const Compositor::LAYERROW& layer, uint32_t pixel_x, uint64_t coverage, uint8_t* indices)
+{
+	COMPOSITOR_FILL_BLOCK(FetchSSE41)
+}
+
+COMPOSITOR_TARGET("avx2")
+static uint64_t FillBlockAVX2(const Compositor::LAYERROW& layer, uint32_t pixel_x, uint64_t coverage, uint8_t* indices)
+{
+	COMPOSITOR_FILL_BLOCK(FetchAVX2)
+}
+
+#undef COMPOSITOR_FILL_BLOCK
+
+COMPOSITOR_TARGET("avx2")
+static void ResolveRowAVX2(const uint8_t* indices, const uint32_t* lut, uint32_t* row, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		__m256i lookup = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&indices[x]));
+
+		_mm256_storeu_si256((__m256i*)&row[x], _mm256_i32gather_epi32((const int*)lut, lookup, 4));
+	}
+
+	ResolveRowScalar(&indices[x], lut, &row[x], width - x);
+}
+
+COMPOSITOR_TARGET("avx2")
+static void SampleRowAVX2(const Compositor::LAYERAFFINE& layer, uint8_t* row, uint32_t width)
+{
+	// Eight pixels per step, both coordinates advance by their per pixel step times eight
+
+	uint32_t size = layer.tile_map ? (Compositor::MAP_WIDTH << layer.tile_shift) : Compositor::ROW_WIDTH;
+
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i size_mask = _mm256_set1_epi32(size - 1);
+	const __m256i mask_byte = _mm256_set1_epi32(0xff);
+	const __m256i step_x = _mm256_set1_epi32(layer.pixel_x_step * 8);
+	const __m256i step_y = _mm256_set1_epi32(layer.pixel_y_step * 8);
+
+	const __m128i tile_shift = _mm_cvtsi32_si128(layer.tile_shift);
+	const __m256i fine_mask = _mm256_set1_epi32((1 << layer.tile_shift) - 1);
+	const __m256i tile_mask = _mm256_set1_epi32(0x03ff & (layer.tile_count - 1));
+	const __m256i flip_x = _mm256_set1_epi32(0x0400);
+	const __m256i flip_y = _mm256_set1_epi32(0x0800);
+	const __m256i palette_mask = _mm256_set1_epi32(0xf000);
+	const __m256i entry_mask = _mm256_set1_epi32(0xffff);
+
+	__m256i pixel_x = _mm256_add_epi32(_mm256_set1_epi32(layer.pixel_x), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(layer.pixel_x_step)));
+	__m256i pixel_y = _mm256_add_epi32(_mm256_set1_epi32(layer.pixel_y), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(layer.pixel_y_step)));
+
+	uint32_t i = 0;
+
+	for (; i + 8 <= width; i += 8)
+	{
+		__m256i source_x;
+		__m256i source_y;
+
+		if (layer.clamp)
+		{
+			source_x = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(pixel_x, 16), zero), size_mask);
+			source_y = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(pixel_y, 16), zero), size_mask);
+		}
+		else
+		{
+			source_x = _mm256_and_si256(_mm256_srli_epi32(pixel_x, 16), size_mask);
+			source_y = _mm256_and_si256(_mm256_srli_epi32(pixel_y, 16), size_mask);
+		}
+
+		__m256i pixel;
+
+		if (layer.tile_map == nullptr)
+		{
+			__m256i offset = _mm256_add_epi32(source_x, _mm256_slli_epi32(source_y, 10));
+
+			pixel = _mm256_and_si256(_mm256_i32gather_epi32((const int*)layer.source, offset, 1), mask_byte);
+		}
+		else
+		{
+			__m256i map_index = _mm256_add_epi32(_mm256_slli_epi32(_mm256_srl_epi32(source_y, tile_shift), 6), _mm256_srl_epi32(source_x, tile_shift));
+			__m256i entry = _mm256_and_si256(_mm256_i32gather_epi32((const int*)layer.tile_map, map_index, 2), entry_mask);
+			__m256i tile = _mm256_and_si256(entry, tile_mask);
+
+			__m256i fine_x = _mm256_xor_si256(_mm256_and_si256(source_x, fine_mask), _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(entry, flip_x), flip_x), fine_mask));
+			__m256i fine_y = _mm256_xor_si256(_mm256_and_si256(source_y, fine_mask), _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(entry, flip_y), flip_y), fine_mask));
+
+			__m256i offset = _mm256_add_epi32(_mm256_sll_epi32(_mm256_add_epi32(_mm256_sll_epi32(tile, tile_shift), fine_y), tile_shift), fine_x);
+
+			pixel = _mm256_and_si256(_mm256_i32gather_epi32((const int*)layer.source, offset, 1), mask_byte);
+			pixel = _mm256_andnot_si256(_mm256_cmpeq_epi32(pixel, zero), _mm256_or_si256(pixel, _mm256_srli_epi32(_mm256_and_si256(entry, palette_mask), 8)));
+		}
+
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(pixel), _mm256_extracti128_si256(pixel, 1));
+
+		_mm_storel_epi64((__m128i*)&row[i], _mm_packus_epi16(packed, packed));
+
+		pixel_x = _mm256_add_epi32(pixel_x, step_x);
+		pixel_y = _mm256_add_epi32(pixel_y, step_y);
+	}
+
+	Compositor::LAYERAFFINE tail = layer;
+
+	tail.pixel_x = layer.pixel_x + i * layer.pixel_x_step;
+	tail.pixel_y = layer.pixel_y + i * layer.pixel_y_step;
+
+	SampleRowScalar(tail, &row[i], width - i);
+}
+
+#endif
+
+static uint64_t SpanMask(const Compositor::LAYERROW& layer, uint32_t pixel_x, uint32_t pixels)
+{
+	// Spans of the source row sampled by the next pixels, wrapping at the row edge
+
+	uint64_t length = (((uint64_t)(pixel_x & 0xffff) + (uint64_t)(pixels - 1) * layer.pixel_x_scale) >> 16) + 1;
+
+	if (length >= Compositor::ROW_WIDTH - Compositor::SPAN_WIDTH)
+		return COVERED;
+
+	uint32_t first = ((pixel_x >> 16) & (Compositor::ROW_WIDTH - 1)) / Compositor::SPAN_WIDTH;
+	uint32_t last = (((pixel_x >> 16) + (uint32_t)length - 1) & (Compositor::ROW_WIDTH - 1)) / Compositor::SPAN_WIDTH;
+
+	if (first <= last)
+		return (COVERED >> (63 - last)) & (COVERED << first);
+
+	return (COVERED >> (63 - last)) | (COVERED << first);
+}
+
+Compositor::Compositor()
+{
+	SetISA(Detect());
+}
+
+Compositor::~Compositor()
+{
+}
+
+Compositor::ISA Compositor::Detect()
+{
+#ifdef COMPOSITOR_X86
+#if defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 1);
+
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	__cpuidex(info, 7, 0);
+
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+
+	if (avx2 && avx && osxsave && ((_xgetbv(0) & 0x6) == 0x6))
+		return ISA::AVX2;
+
+	if (sse41)
+		return ISA::SSE41;
+#else
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return ISA::AVX2;
+
+	if (__builtin_cpu_supports("sse4.1"))
+		return ISA::SSE41;
+#endif
+#endif
+
+	return ISA::SCALAR;
+}
+
+Compositor::ISA Compositor::GetISA()
+{
+	return isa;
+}
+
+void Compositor::SetISA(ISA isa)
+{
+	// Never select more than the host supports
+
+	if ((int)isa > (int)Detect())
+		isa = Detect();
+
+	this->isa = isa;
+
+	switch (isa)
+	{
+#ifdef COMPOSITOR_X86
+	case ISA::AVX2:
+		fill_block = &FillBlockAVX2;
+		resolve_row = &ResolveRowAVX2;
+		sample_row = &SampleRowAVX2;
+		break;
+	case ISA::SSE41:
+		fill_block = &FillBlockSSE41;
+		resolve_row = &ResolveRowScalar;
+		sample_row = &SampleRowScalar;
+		break;
+#endif
+	default:
+		fill_block = &FillBlockScalar;
+		resolve_row = &ResolveRowScalar;
+		sample_row = &SampleRowScalar;
+		break;
+	}
+}
+
+std::string Compositor::Name(ISA isa)
+{
+	switch (isa)
+	{
+	case ISA::AVX2:
+		return "AVX2";
+	case ISA::SSE41:
+		return "SSE4.1";
+	default:
+		return "scalar";
+	}
+}
+
+static uint32_t Blocks(uint32_t width)
+{
+	return (width + Compositor::BLOCK_WIDTH - 1) / Compositor::BLOCK_WIDTH;
+}
+
+uint32_t Compositor::IndicesSize(uint32_t width)
+{
+	return Blocks(width) * BLOCK_WIDTH;
+}
+
+uint32_t Compositor::CoverageSize(uint32_t width)
+{
+	// Coverage words, then the pixels already resolved through a layer lut
+
+	return Blocks(width) * 2;
+}
+
+void Compositor::ResolveOwn(const uint32_t* lut, const uint8_t* indices, uint64_t pixels, uint32_t* row)
+{
+	// pixels is a BLOCK_WIDTH mask, only blocks inside the row can be complete
+
+	if (pixels == COVERED)
+	{
+		resolve_row(indices, lut, row, BLOCK_WIDTH);
+		return;
+	}
+
+	for (uint32_t i = 0; i < BLOCK_WIDTH; i++)
+	{
+		if (pixels & (1ull << i))
+			row[i] = lut[indices[i]];
+	}
+}
+
+void Compositor::Compose(const LAYERROW* layers, uint32_t count, const uint32_t* lut, uint32_t* row, uint32_t width, uint8_t* indices, uint64_t* coverage)
+{
+	uint32_t blocks = Blocks(width);
+	uint32_t uncovered = blocks;
+	uint64_t* resolved = &coverage[blocks];
+	bool own = false;
+
+	memset(indices, 0, blocks * BLOCK_WIDTH);
+
+	for (uint32_t block = 0; block < blocks; block++)
+	{
+		coverage[block] = 0;
+		resolved[block] = 0;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		own = own || (layers[i].lut != nullptr && layers[i].lut != lut);
+
+	// Pixels past the end of the row count as covered so the last block can complete
+
+	if (width % BLOCK_WIDTH)
+		coverage[blocks - 1] = COVERED << (width % BLOCK_WIDTH);
+
+	for (uint32_t i = 0; i < count && uncovered > 0; i++)
+	{
+		const LAYERROW& layer = layers[i];
+		const uint32_t* layer_lut = (layer.lut != nullptr && layer.lut != lut) ? layer.lut : nullptr;
+		uint32_t pixel_x = layer.pixel_x;
+
+		if (layer.spans == 0)
+			continue;
+
+		if (layer.affine != nullptr)
+		{
+			// Only blocks that are still uncovered are sampled, then merged as an unscaled row
+
+			alignas(16) uint8_t sampled[BLOCK_WIDTH + ROW_PADDING];
+			LAYERROW block_row = { sampled, 0, 0x10000, COVERED, nullptr, nullptr };
+			LAYERAFFINE affine = *layer.affine;
+
+			for (uint32_t block = 0; block < blocks; block++)
+			{
+				if (coverage[block] != COVERED)
+				{
+					affine.pixel_x = layer.affine->pixel_x + (block * BLOCK_WIDTH * layer.affine->pixel_x_step);
+					affine.pixel_y = layer.affine->pixel_y + (block * BLOCK_WIDTH * layer.affine->pixel_y_step);
+
+					sample_row(affine, sampled, BLOCK_WIDTH);
+
+					uint64_t covered = fill_block(block_row, 0, coverage[block], &indices[block * BLOCK_WIDTH]);
+
+					if (layer_lut != nullptr)
+					{
+						ResolveOwn(layer_lut, &indices[block * BLOCK_WIDTH], covered & ~coverage[block], &row[block * BLOCK_WIDTH]);
+						resolved[block] |= covered & ~coverage[block];
+					}
+
+					coverage[block] = covered;
+
+					if (coverage[block] == COVERED)
+						--uncovered;
+				}
+			}
+
+			continue;
+		}
+
+		for (uint32_t block = 0; block < blocks; block++, pixel_x += layer.pixel_x_scale * BLOCK_WIDTH)
+		{
+			if (coverage[block] == COVERED)
+				continue;
+
+			if ((layer.spans & SpanMask(layer, pixel_x, BLOCK_WIDTH)) == 0)
+				continue;
+
+			uint64_t covered = fill_block(layer, pixel_x, coverage[block], &indices[block * BLOCK_WIDTH]);
+
+			if (layer_lut != nullptr)
+			{
+				ResolveOwn(layer_lut, &indices[block * BLOCK_WIDTH], covered & ~coverage[block], &row[block * BLOCK_WIDTH]);
+				resolved[block] |= covered & ~coverage[block];
+			}
+
+			coverage[block] = covered;
+
+			if (coverage[block] == COVERED)
+				--uncovered;
+		}
+	}
+
+	if (!own)
+	{
+		resolve_row(indices, lut, row, width);
+		return;
+	}
+
+	// Remaining pixels use the shared lut, bits past the end of the row are never set in resolved
+
+	for (uint32_t block = 0; block < blocks; block++)
+	{
+		uint32_t x = block * BLOCK_WIDTH;
+
+		if (resolved[block] == 0)
+			resolve_row(&indices[x], lut, &row[x], std::min(BLOCK_WIDTH, width - x));
+		else if (resolved[block] != COVERED)
+			ResolveOwn(lut, &indices[x], ~resolved[block] & (COVERED >> (BLOCK_WIDTH - std::min(BLOCK_WIDTH, width - x))), &row[x]);
+	}
+}
+
+uint8_t Compositor::SamplePixel(const LAYERAFFINE& layer, uint32_t x)
+{
+	uint8_t pixel;
+	LAYERAFFINE single = layer;
+
+	single.pixel_x = layer.pixel_x + (x * layer.pixel_x_step);
+	single.pixel_y = layer.pixel_y + (x * layer.pixel_y_step);
+
+	SampleRowScalar(single, &pixel, 1);
+
+	return pixel;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+class Compositor
+{
+public:
+	enum class ISA
+	{
+		SCALAR = 0,
+		SSE41 = 1,
+		AVX2 = 2,
+	};
+
+	static const uint32_t ROW_WIDTH = 1024;		// pixels in a layer source row
+	static const uint32_t ROW_PADDING = 16;		// readable bytes required past the end of a layer buffer
+	static const uint32_t SPAN_WIDTH = 16;		// source pixels per bit of LAYERROW::spans
+	static const uint32_t BLOCK_WIDTH = 64;		// output pixels per coverage word
+	static const uint32_t MAP_WIDTH = 64;		// tile map entries per row and column
+
+	typedef struct
+	{
+		const uint8_t* source;		// ROW_WIDTH square bitmap, or decoded tile patterns when tile_map is set
+		const uint16_t* tile_map;	// MAP_WIDTH square map using the Video entry layout, nullptr for bitmaps
+		uint32_t tile_shift;		// log2 of the tile size
+		uint32_t tile_count;		// patterns in source, a power of two
+		uint32_t pixel_x;			// 16.16 fixed point source position of the first pixel
+		uint32_t pixel_y;
+		uint32_t pixel_x_step;		// 16.16 fixed point source step per pixel
+		uint32_t pixel_y_step;
+		bool clamp;					// clamp to the layer edge instead of wrapping
+	} LAYERAFFINE;
+
+	typedef struct
+	{
+		const uint8_t* source;		// layer source row, ROW_WIDTH pixels
+		uint32_t pixel_x;			// 10.16 fixed point x of the first pixel
+		uint32_t pixel_x_scale;		// 10.16 fixed point x step per pixel
+		uint64_t spans;				// bit n set when source pixels [n * SPAN_WIDTH, (n + 1) * SPAN_WIDTH) may be opaque
+		const LAYERAFFINE* affine;	// when set the layer is sampled a block at a time instead of read from source
+		const uint32_t* lut;		// palette of the layer, nullptr for the lut passed to Compose
+	} LAYERROW;
+
+	// Merges one BLOCK_WIDTH block of a layer into indices where still transparent, returns the opaque mask
+	typedef uint64_t (*FillBlock)(const LAYERROW& layer, uint32_t pixel_x, uint64_t coverage, uint8_t* indices);
+	typedef void (*ResolveRow)(const uint8_t* indices, const uint32_t* lut, uint32_t* row, uint32_t width);
+	typedef void (*SampleRow)(const LAYERAFFINE& layer, uint8_t* row, uint32_t width);
+
+private:
+	ISA isa;
+	FillBlock fill_block;
+	ResolveRow resolve_row;
+	SampleRow sample_row;
+
+	void ResolveOwn(const uint32_t* lut, const uint8_t* indices, uint64_t pixels, uint32_t* row);
+
+public:
+	Compositor();
+	~Compositor();
+
+	static ISA Detect();
+
+	ISA GetISA();
+	void SetISA(ISA isa);
+
+	static std::string Name(ISA isa);
+
+	// Scratch sizes for a row of width pixels
+	static uint32_t IndicesSize(uint32_t width);
+	static uint32_t CoverageSize(uint32_t width);
+
+	// Front layer first, the first non-zero index wins and is resolved through lut (lut[0] is the background).
+	// Layers are composited one at a time with a coverage bit per output pixel, blocks that are already
+	// covered or that only sample transparent spans of a layer are never fetched. Pixels of a layer with
+	// its own lut are resolved as they land, everything else in one pass at the end.
+	void Compose(const LAYERROW* layers, uint32_t count, const uint32_t* lut, uint32_t* row, uint32_t width, uint8_t* indices, uint64_t* coverage);
+
+	// Index of pixel x along a transformed layer row, for single pixel tests outside Compose
+	static uint8_t SamplePixel(const LAYERAFFINE& layer, uint32_t x);
+};
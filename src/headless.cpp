@@ -0,0 +1,90 @@
+#include "headless.h"
+
+Headless::Headless(uint32_t display_width, uint32_t display_height, const Machine::MAP& map)
+{
+	this->display_width = display_width;
+	this->display_height = display_height;
+
+	machine = std::make_shared<Machine>(display_width, display_height, map);
+	frame = std::make_unique<uint32_t[]>(display_width * display_height);
+
+	frame_count = 0;
+	render_interval = 1;
+}
+
+Headless::~Headless()
+{
+}
+
+Machine::SharedPtr Headless::GetMachine()
+{
+	return machine;
+}
+
+void Headless::SetCapture(Capture::SharedPtr capture)
+{
+	this->capture = capture;
+}
+
+void Headless::SetRenderInterval(uint32_t render_interval)
+{
+	this->render_interval = render_interval;
+}
+
+bool Headless::Frame()
+{
+	// Same per frame step as the windowed front end, returns whether the image changed. Frames
+	// between render intervals only run the guest.
+
+	machine->RunFrame();
+
+	++frame_count;
+
+	if (render_interval == 0 || frame_count % render_interval != 0)
+		return false;
+
+	return Render();
+}
+
+bool Headless::Render()
+{
+	bool changed = machine->GetVideo()->Render(frame.get());
+
+	if (capture)
+		capture->Submit(frame.get());
+
+	return changed;
+}
+
+const uint32_t* Headless::GetFrame()
+{
+	return frame.get();
+}
+
+uint32_t Headless::GetChecksum()
+{
+	// FNV-1a over the RGBA bytes of the last rendered frame
+
+	uint32_t checksum = 0x811c9dc5;
+	const uint8_t* bytes = (const uint8_t*)frame.get();
+
+	for (uint32_t i = 0; i < display_width * display_height * sizeof(uint32_t); i++)
+		checksum = (checksum ^ bytes[i]) * 0x01000193;
+
+	return checksum;
+}
+
+uint32_t Headless::GetWidth()
+{
+	return display_width;
+}
+
+uint32_t Headless::GetHeight()
+{
+	return display_height;
+}
+
+uint64_t Headless::GetFrameCount()
+{
+	return frame_count;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "machine.h"
+#include "capture.h"
+
+// Runs a Machine into an in-memory RGBA frame (olc::Pixel layout) with no window or graphics context
+
+class Headless
+{
+public:
+	typedef std::shared_ptr<Headless> SharedPtr;
+
+private:
+	uint32_t display_width;
+	uint32_t display_height;
+
+	Machine::SharedPtr machine;
+	std::unique_ptr<uint32_t[]> frame;
+	Capture::SharedPtr capture;
+
+	uint64_t frame_count;
+	uint32_t render_interval;	// render every nth frame, 0 never renders
+
+public:
+	Headless(uint32_t display_width, uint32_t display_height, const Machine::MAP& map = Machine::DefaultMap());
+	~Headless();
+
+	Machine::SharedPtr GetMachine();
+
+	void SetCapture(Capture::SharedPtr capture);
+	void SetRenderInterval(uint32_t render_interval);
+
+	bool Frame();
+	bool Render();
+
+	const uint32_t* GetFrame();
+	uint32_t GetChecksum();
+	uint32_t GetWidth();
+	uint32_t GetHeight();
+	uint64_t GetFrameCount();
+};
@@ -0,0 +1,153 @@
+#include "input.h"
+
+Input::Input()
+{
+	pending = InputLog::Empty();
+	latched = InputLog::Empty();
+
+	mode = MODE::LIVE;
+}
+
+Input::~Input()
+{
+}
+
+void Input::SetPending(const InputLog::FRAME& input)
+{
+	// Stop, start and layer toggles are pulses, one set since the last latch is kept until a frame
+	// takes it
+
+	uint8_t pulses = pending.controls & (InputLog::CONTROL_STOP | InputLog::CONTROL_START);
+	uint8_t layer_toggles = pending.layer_toggles;
+
+	pending = input;
+	pending.controls |= pulses;
+	pending.layer_toggles ^= layer_toggles;
+}
+
+const InputLog::FRAME& Input::GetLatched()
+{
+	return latched;
+}
+
+void Input::Latch(uint64_t frame)
+{
+	// Called by the machine before it runs emulated frame number frame. A replay past the end of
+	// its log holds the last logged input.
+
+	if (mode == MODE::REPLAY)
+		log->Get(frame, pending);
+
+	latched = pending;
+
+	pending.controls &= ~(InputLog::CONTROL_STOP | InputLog::CONTROL_START);
+	pending.layer_toggles = 0;
+
+	if (mode == MODE::RECORD)
+		log->Set(frame, latched);
+}
+
+void Input::Live()
+{
+	mode = MODE::LIVE;
+	log.reset();
+}
+
+void Input::Record(InputLog::SharedPtr log)
+{
+	this->log = log;
+	mode = MODE::RECORD;
+}
+
+void Input::Replay(InputLog::SharedPtr log)
+{
+	this->log = log;
+	mode = MODE::REPLAY;
+}
+
+Input::MODE Input::GetMode()
+{
+	return mode;
+}
+
+void Input::MapPages(Bus* bus)
+{
+	bus->MapPages(START, END, nullptr, nullptr, this);
+}
+
+void Input::SaveState(State& state)
+{
+	// Both frames, a state taken between frames resumes with the input it would have latched
+
+	state.Begin("INPT");
+
+	for (const InputLog::FRAME* input : { &pending, &latched })
+	{
+		state.Put16(input->mouse_x);
+		state.Put16(input->mouse_y);
+		state.Put8(input->buttons);
+		state.PutBytes(input->keys, InputLog::KEY_BYTES);
+		state.Put8(input->controls);
+		state.Put8(input->layer_toggles);
+		InputLog::PutTransforms(state, *input);
+	}
+
+	state.End();
+}
+
+bool Input::LoadState(State& state)
+{
+	if (!state.Find("INPT"))
+		return false;
+
+	for (InputLog::FRAME* input : { &pending, &latched })
+	{
+		input->mouse_x = state.Get16();
+		input->mouse_y = state.Get16();
+		input->buttons = state.Get8();
+		state.GetBytes(input->keys, InputLog::KEY_BYTES);
+		input->controls = state.Get8();
+		input->layer_toggles = state.Get8();
+		InputLog::GetTransforms(state, *input);
+	}
+
+	return !state.GetFailed();
+}
+
+bool Input::ValidWrite(uint32_t address)
+{
+	return ValidRead(address);
+}
+
+bool Input::ValidRead(uint32_t address)
+{
+	return address >= START && address <= END;
+}
+
+void Input::Write(uint32_t address, uint8_t data)
+{
+}
+
+uint8_t Input::Read(uint32_t address)
+{
+	uint32_t offset = address & 0x1f;
+
+	if (offset >= REGISTER_KEYS)
+		return latched.keys[offset - REGISTER_KEYS];
+
+	switch (offset)
+	{
+	case REGISTER_MOUSE_X:
+		return latched.mouse_x & 0xff;
+	case REGISTER_MOUSE_X + 1:
+		return latched.mouse_x >> 8;
+	case REGISTER_MOUSE_Y:
+		return latched.mouse_y & 0xff;
+	case REGISTER_MOUSE_Y + 1:
+		return latched.mouse_y >> 8;
+	case REGISTER_BUTTONS:
+		return latched.buttons;
+	}
+
+	return 0x00;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "bus.h"
+#include "inputlog.h"
+
+// Host input as the guest sees it. The host sets the pending input whenever it likes and it is
+// latched at the start of every emulated frame, so input never changes part way through a frame
+// and a run is repeated exactly by feeding the same latched frames. The host's controls of the
+// machine travel the same way and the machine applies them as it latches. Latched frames can be
+// recorded to an InputLog, or taken from one instead of the host.
+
+class Input : public BusDevice
+{
+public:
+	typedef std::shared_ptr<Input> SharedPtr;
+
+	static const uint32_t START = 0x103000;		// registers mirrored across the page, read only
+	static const uint32_t END = 0x103fff;
+
+	static const uint32_t REGISTER_MOUSE_X = 0x00;	// 16 bit little endian
+	static const uint32_t REGISTER_MOUSE_Y = 0x02;	// 16 bit little endian
+	static const uint32_t REGISTER_BUTTONS = 0x04;
+	static const uint32_t REGISTER_KEYS = 0x10;		// InputLog::KEY_BYTES bytes, bit per olc::Key
+
+	enum class MODE
+	{
+		LIVE = 0,		// latch the host input
+		RECORD = 1,		// latch the host input and add it to the log
+		REPLAY = 2,		// latch the logged input, the host input is ignored
+	};
+
+private:
+	InputLog::FRAME pending;
+	InputLog::FRAME latched;
+
+	MODE mode;
+	InputLog::SharedPtr log;
+
+public:
+	Input();
+	~Input();
+
+	void SetPending(const InputLog::FRAME& input);
+	const InputLog::FRAME& GetLatched();
+	void Latch(uint64_t frame);
+
+	void Live();
+	void Record(InputLog::SharedPtr log);
+	void Replay(InputLog::SharedPtr log);
+	MODE GetMode();
+
+	void MapPages(Bus* bus);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	bool ValidWrite(uint32_t address) override;
+	bool ValidRead(uint32_t address) override;
+	void Write(uint32_t address, uint8_t data) override;
+	uint8_t Read(uint32_t address) override;
+
+};
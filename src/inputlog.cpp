@@ -0,0 +1,379 @@
+#include "inputlog.h"
+
+InputLog::InputLog()
+{
+	Clear(0);
+}
+
+InputLog::~InputLog()
+{
+}
+
+InputLog::FRAME InputLog::Empty()
+{
+	FRAME input;
+
+	memset(&input, 0, sizeof(input));
+
+	return input;
+}
+
+void InputLog::PutTransforms(State& state, const FRAME& input)
+{
+	// Floats go as their bit patterns, a replay sets exactly the recorded transforms
+
+	for (const TRANSFORM& transform : input.transforms)
+	{
+		for (float value : { transform.scale_x, transform.scale_y, transform.angle, transform.origin_x, transform.origin_y, transform.centre_x, transform.centre_y })
+		{
+			uint32_t bits;
+
+			memcpy(&bits, &value, sizeof(bits));
+			state.Put32(bits);
+		}
+	}
+}
+
+void InputLog::GetTransforms(State& state, FRAME& input)
+{
+	for (TRANSFORM& transform : input.transforms)
+	{
+		for (float* value : { &transform.scale_x, &transform.scale_y, &transform.angle, &transform.origin_x, &transform.origin_y, &transform.centre_x, &transform.centre_y })
+		{
+			uint32_t bits = state.Get32();
+
+			memcpy(value, &bits, sizeof(bits));
+		}
+	}
+}
+
+void InputLog::Clear(uint64_t first_frame)
+{
+	this->first_frame = first_frame;
+
+	frames.clear();
+	start_state.Clear();
+	checkpoints.clear();
+}
+
+void InputLog::Set(uint64_t frame, const FRAME& input)
+{
+	// Frames are recorded in order, recording an earlier frame again (after a rewind) drops the
+	// frames after it and a gap repeats the last input
+
+	if (frame < first_frame)
+		return;
+
+	uint64_t index = frame - first_frame;
+
+	if (index < frames.size())
+	{
+		frames.resize((size_t)index);
+		checkpoints.erase(checkpoints.upper_bound(frame), checkpoints.end());
+	}
+
+	while (frames.size() < index)
+		frames.push_back(frames.empty() ? Empty() : frames.back());
+
+	frames.push_back(input);
+}
+
+bool InputLog::Get(uint64_t frame, FRAME& input)
+{
+	if (frame < first_frame || frame - first_frame >= frames.size())
+		return false;
+
+	input = frames[(size_t)(frame - first_frame)];
+
+	return true;
+}
+
+uint64_t InputLog::GetFirstFrame()
+{
+	return first_frame;
+}
+
+uint64_t InputLog::GetFrameCount()
+{
+	return frames.size();
+}
+
+void InputLog::SetStartState(State& state)
+{
+	// Checkpoints are deltas against the start state
+
+	start_state.Clear();
+	start_state.GetChunks() = state.GetChunks();
+	checkpoints.clear();
+}
+
+bool InputLog::GetStartState(State& state)
+{
+	if (start_state.GetSize() == 0)
+		return false;
+
+	state.Clear();
+	state.GetChunks() = start_state.GetChunks();
+
+	return true;
+}
+
+void InputLog::SetCheckpoint(uint64_t frame, State& state)
+{
+	// The state the machine is in before it runs frame
+
+	std::vector<uint8_t>& chunks = state.GetChunks();
+	Checkpoint& checkpoint = checkpoints[frame];
+
+	checkpoint.size = chunks.size();
+	checkpoint.delta = (chunks.size() == start_state.GetSize());
+
+	if (checkpoint.delta)
+	{
+		std::vector<uint8_t> delta(chunks.size());
+
+		State::Xor(chunks.data(), start_state.GetChunks().data(), delta.data(), delta.size());
+		State::Compress(delta.data(), delta.size(), checkpoint.data);
+	}
+	else
+	{
+		State::Compress(chunks.data(), chunks.size(), checkpoint.data);
+	}
+
+	checkpoint.data.shrink_to_fit();
+}
+
+bool InputLog::GetCheckpoint(uint64_t frame, State& state, uint64_t& checkpoint_frame)
+{
+	// The latest checkpoint at or before frame, or the start state
+
+	auto it = checkpoints.upper_bound(frame);
+
+	if (it == checkpoints.begin())
+	{
+		checkpoint_frame = first_frame;
+		return GetStartState(state);
+	}
+
+	--it;
+
+	const Checkpoint& checkpoint = it->second;
+	std::vector<uint8_t>& chunks = state.GetChunks();
+
+	state.Clear();
+	chunks.resize(checkpoint.size);
+
+	if (!State::Decompress(checkpoint.data.data(), checkpoint.data.size(), chunks.data(), chunks.size()))
+		return false;
+
+	if (checkpoint.delta)
+		State::Xor(chunks.data(), start_state.GetChunks().data(), chunks.data(), chunks.size());
+
+	checkpoint_frame = it->first;
+
+	return true;
+}
+
+bool InputLog::HasCheckpoint(uint64_t frame)
+{
+	return checkpoints.count(frame) != 0;
+}
+
+bool InputLog::MatchCheckpoint(uint64_t frame, State& state)
+{
+	// Whether state is exactly the checkpoint taken before frame
+
+	auto it = checkpoints.find(frame);
+
+	if (it == checkpoints.end())
+		return false;
+
+	const Checkpoint& checkpoint = it->second;
+	std::vector<uint8_t>& chunks = state.GetChunks();
+
+	if (chunks.size() != checkpoint.size)
+		return false;
+
+	std::vector<uint8_t> recorded(checkpoint.size);
+
+	if (!State::Decompress(checkpoint.data.data(), checkpoint.data.size(), recorded.data(), recorded.size()))
+		return false;
+
+	if (checkpoint.delta)
+		State::Xor(recorded.data(), start_state.GetChunks().data(), recorded.data(), recorded.size());
+
+	return recorded == chunks;
+}
+
+size_t InputLog::GetCheckpointCount()
+{
+	return checkpoints.size();
+}
+
+size_t InputLog::GetCheckpointSize()
+{
+	size_t size = 0;
+
+	for (auto& it : checkpoints)
+		size += it.second.data.size();
+
+	return size;
+}
+
+void InputLog::SaveState(State& state)
+{
+	state.Begin("ILOG");
+
+	state.Put64(first_frame);
+	state.Put64(frames.size());
+
+	FRAME previous = Empty();
+
+	for (const FRAME& input : frames)
+	{
+		uint8_t changed = 0;
+
+		changed |= (input.mouse_x != previous.mouse_x) ? CHANGED_MOUSE_X : 0;
+		changed |= (input.mouse_y != previous.mouse_y) ? CHANGED_MOUSE_Y : 0;
+		changed |= (input.buttons != previous.buttons) ? CHANGED_BUTTONS : 0;
+		changed |= (memcmp(input.keys, previous.keys, KEY_BYTES) != 0) ? CHANGED_KEYS : 0;
+		changed |= (input.controls != previous.controls || input.layer_toggles != previous.layer_toggles) ? CHANGED_CONTROLS : 0;
+		changed |= (memcmp(input.transforms, previous.transforms, sizeof(input.transforms)) != 0) ? CHANGED_TRANSFORMS : 0;
+
+		state.Put8(changed);
+
+		if (changed & CHANGED_MOUSE_X)
+			state.Put16(input.mouse_x);
+		if (changed & CHANGED_MOUSE_Y)
+			state.Put16(input.mouse_y);
+		if (changed & CHANGED_BUTTONS)
+			state.Put8(input.buttons);
+		if (changed & CHANGED_KEYS)
+			state.PutBytes(input.keys, KEY_BYTES);
+
+		if (changed & CHANGED_CONTROLS)
+		{
+			state.Put8(input.controls);
+			state.Put8(input.layer_toggles);
+		}
+
+		if (changed & CHANGED_TRANSFORMS)
+			PutTransforms(state, input);
+
+		previous = input;
+	}
+
+	state.End();
+
+	if (start_state.GetSize() != 0)
+	{
+		std::vector<uint8_t> bytes = start_state.Serialise(false);
+
+		state.Begin("STRT");
+		state.PutBytes(bytes.data(), bytes.size());
+		state.End();
+	}
+
+	if (!checkpoints.empty())
+	{
+		state.Begin("CKPT");
+		state.Put64(checkpoints.size());
+
+		for (auto& it : checkpoints)
+		{
+			state.Put64(it.first);
+			state.Put8(it.second.delta ? 1 : 0);
+			state.Put64(it.second.size);
+			state.Put64(it.second.data.size());
+			state.PutBytes(it.second.data.data(), it.second.data.size());
+		}
+
+		state.End();
+	}
+}
+
+bool InputLog::LoadState(State& state)
+{
+	if (!state.Find("ILOG"))
+		return false;
+
+	Clear(state.Get64());
+
+	uint64_t count = state.Get64();
+	FRAME input = Empty();
+
+	for (uint64_t i = 0; i < count && !state.GetFailed(); i++)
+	{
+		uint8_t changed = state.Get8();
+
+		if (changed & CHANGED_MOUSE_X)
+			input.mouse_x = state.Get16();
+		if (changed & CHANGED_MOUSE_Y)
+			input.mouse_y = state.Get16();
+		if (changed & CHANGED_BUTTONS)
+			input.buttons = state.Get8();
+		if (changed & CHANGED_KEYS)
+			state.GetBytes(input.keys, KEY_BYTES);
+
+		if (changed & CHANGED_CONTROLS)
+		{
+			input.controls = state.Get8();
+			input.layer_toggles = state.Get8();
+		}
+
+		if (changed & CHANGED_TRANSFORMS)
+			GetTransforms(state, input);
+
+		frames.push_back(input);
+	}
+
+	if (state.GetFailed())
+		return false;
+
+	if (state.Has("STRT") && state.Find("STRT"))
+	{
+		std::vector<uint8_t> bytes(state.GetRemaining());
+
+		if (!state.GetBytes(bytes.data(), bytes.size()) || !start_state.Deserialise(bytes.data(), bytes.size()))
+			return false;
+	}
+
+	if (state.Has("CKPT") && state.Find("CKPT"))
+	{
+		uint64_t count = state.Get64();
+
+		for (uint64_t i = 0; i < count && !state.GetFailed(); i++)
+		{
+			Checkpoint& checkpoint = checkpoints[state.Get64()];
+
+			checkpoint.delta = state.Get8() != 0;
+			checkpoint.size = (size_t)state.Get64();
+
+			uint64_t length = state.Get64();
+
+			if (length > state.GetRemaining() || (checkpoint.delta && checkpoint.size != start_state.GetSize()))
+				return false;
+
+			checkpoint.data.resize((size_t)length);
+			state.GetBytes(checkpoint.data.data(), checkpoint.data.size());
+		}
+	}
+
+	return !state.GetFailed();
+}
+
+bool InputLog::Save(std::string filename)
+{
+	State state;
+
+	SaveState(state);
+
+	return state.Save(filename, true);
+}
+
+bool InputLog::Load(std::string filename)
+{
+	State state;
+
+	return state.Load(filename) && LoadState(state);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "state.h"
+
+// Host input of consecutive emulated frames, optionally with the machine state the first frame
+// starts from and checkpoints of the state at later frames. A frame also carries the host's own
+// controls of the machine (reset, stop and start, layer enables and transforms) so a replay repeats
+// them on the same frames. Saved as a compressed State container holding an "ILOG" chunk of per
+// frame records (a mask of the fields that changed from the previous frame, then those fields), an
+// optional "STRT" chunk with the uncompressed start state and an optional "CKPT" chunk of
+// checkpoints. A checkpoint is the compressed XOR of its chunk area with the start state's, or the
+// compressed chunk area itself when the sizes differ.
+
+class InputLog
+{
+public:
+	typedef std::shared_ptr<InputLog> SharedPtr;
+
+	static const uint32_t KEY_BYTES = 16;		// one bit per olc::Key
+	static const uint32_t LAYERS = 4;			// Video::LAYERS
+
+	static const uint8_t CONTROL_RESET = 0x01;		// RESB held low for the frame
+	static const uint8_t CONTROL_STOP = 0x02;		// stop the machine before the frame
+	static const uint8_t CONTROL_START = 0x04;		// start it again, after any stop
+	static const uint8_t CONTROL_TRANSFORM = 0x08;	// set the layer transforms before the frame
+
+	typedef struct
+	{
+		float scale_x;
+		float scale_y;
+		float angle;
+		float origin_x;
+		float origin_y;
+		float centre_x;
+		float centre_y;
+	} TRANSFORM;
+
+	typedef struct
+	{
+		uint16_t mouse_x;
+		uint16_t mouse_y;
+		uint8_t buttons;				// bit n: mouse button n held
+		uint8_t keys[KEY_BYTES];		// bit k % 8 of byte k / 8: key k held
+		uint8_t controls;				// CONTROL_ bits, the host's own controls of the machine
+		uint8_t layer_toggles;			// bit n: flip layer n enabled before the frame
+		TRANSFORM transforms[LAYERS];	// with CONTROL_TRANSFORM, Video::SetTransform per layer
+	} FRAME;
+
+	static const uint8_t CHANGED_MOUSE_X = 0x01;
+	static const uint8_t CHANGED_MOUSE_Y = 0x02;
+	static const uint8_t CHANGED_BUTTONS = 0x04;
+	static const uint8_t CHANGED_KEYS = 0x08;
+	static const uint8_t CHANGED_CONTROLS = 0x10;
+	static const uint8_t CHANGED_TRANSFORMS = 0x20;
+
+private:
+	class Checkpoint {
+	public:
+		bool delta;			// XOR with the start state
+		size_t size;		// chunk area size
+		std::vector<uint8_t> data;
+	};
+
+	uint64_t first_frame;
+	std::vector<FRAME> frames;
+	State start_state;		// empty when the log starts from a reset
+	std::map<uint64_t, Checkpoint> checkpoints;
+
+public:
+	InputLog();
+	~InputLog();
+
+	void Clear(uint64_t first_frame);
+
+	void Set(uint64_t frame, const FRAME& input);
+	bool Get(uint64_t frame, FRAME& input);
+
+	uint64_t GetFirstFrame();
+	uint64_t GetFrameCount();
+
+	void SetStartState(State& state);
+	bool GetStartState(State& state);
+
+	void SetCheckpoint(uint64_t frame, State& state);
+	bool GetCheckpoint(uint64_t frame, State& state, uint64_t& checkpoint_frame);
+	bool HasCheckpoint(uint64_t frame);
+	bool MatchCheckpoint(uint64_t frame, State& state);
+	size_t GetCheckpointCount();
+	size_t GetCheckpointSize();
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+	bool Save(std::string filename);
+	bool Load(std::string filename);
+
+	static FRAME Empty();
+	static void PutTransforms(State& state, const FRAME& input);
+	static void GetTransforms(State& state, FRAME& input);
+};
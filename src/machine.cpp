@@ -0,0 +1,296 @@
+#include "machine.h"
+
+Machine::Machine(uint32_t display_width, uint32_t display_height, const MAP& map)
+{
+	bus = std::make_shared<Bus>();
+	cpu = std::make_shared<W65C816S>(bus);
+	ram = std::make_shared<Ram>(map.ram_start, map.ram_end);
+	rom = std::make_shared<Rom>(map.rom_start, map.rom_end);
+	mapper = std::make_shared<Mapper>(bus.get(), map.mapper_type, map.mapper_start, map.mapper_window, map.mapper_register, map.mapper_length);
+	video = std::make_shared<Video>(display_width, display_height);
+
+	W65C816S* cpu_clock = cpu.get();
+
+	scheduler = std::make_shared<Scheduler>([cpu_clock]() { return cpu_clock->GetClockCount(); });
+	timer = std::make_shared<Timer>(bus, scheduler);
+	input = std::make_shared<Input>();
+
+	clock = std::make_shared<MasterClock>();
+	running = false;
+
+	RESB = bus->AttachLine1Bit("RESB");
+
+	bus->AddDevice(ram);
+	bus->AddDevice(rom);
+	bus->AddDevice(mapper);
+	bus->AddDevice(video);
+	bus->AddDevice(video->GetPaletteRam());
+	bus->AddDevice(timer);
+	bus->AddDevice(input);
+
+	video->SetRenderPool(std::make_shared<RenderPool>());
+	video->MapPages(bus.get());
+	timer->MapPages(bus.get());
+	input->MapPages(bus.get());
+}
+
+Machine::~Machine()
+{
+}
+
+Machine::MAP Machine::DefaultMap()
+{
+	MAP map;
+
+	map.ram_start = 0x000000;
+	map.ram_end = 0x007fff;
+	map.rom_start = 0x008000;
+	map.rom_end = 0x0080ff;
+	map.mapper_type = Mapper::TYPE::RAM;
+	map.mapper_start = 0x010000;
+	map.mapper_window = 0x8000;
+	map.mapper_register = 0x00c000;
+	map.mapper_length = 0x100000;
+
+	return map;
+}
+
+bool Machine::Load(std::string filename)
+{
+	return rom->Load(filename);
+}
+
+bool Machine::LoadBanks(std::string filename)
+{
+	return mapper->Load(filename);
+}
+
+void Machine::Demo()
+{
+	// Test patterns on all four bitmap layers with a blue luminance ramp palette
+
+	uint8_t* screen_buffer_0 = video->GetLayer(0).buffer;
+	uint8_t* screen_buffer_1 = video->GetLayer(1).buffer;
+	uint8_t* screen_buffer_2 = video->GetLayer(2).buffer;
+	uint8_t* screen_buffer_3 = video->GetLayer(3).buffer;
+
+	for (uint32_t i = 0; i < (1024 * 1024); i++)
+	{
+		screen_buffer_0[i] = (((i / (32 * 1024)) + (i / 32)) % 2) * ((i + (i / 1024)) % 256);
+		screen_buffer_1[i] = (((i / (16 * 1024)) + (i / 16)) % 2) * ((i / 2) % 256);
+		screen_buffer_2[i] = (((i / (8 * 1024)) + (i / 8)) % 2) * ((i / 1) % 256);
+		screen_buffer_3[i] = ((i / 1024) % 256);
+	}
+
+	for (uint32_t i = 0; i < Video::LAYERS; i++)
+		video->UpdateSpans(i);
+
+	video->SetEnabled(0b1111);
+
+	for (int i = 0; i < 256; i++)
+	{
+		auto r = 0;// ((i / 64) * 4) % 16;
+		auto g = 0;// ((i / 32) * 4) % 16;
+		auto b = 0x0f;// ((i / 16) * 4) % 16;
+		auto l = i % 16;
+
+		video->SetPalette(i, (r << 12) | (g << 8) | (b << 4) | l);
+	}
+}
+
+void Machine::Start()
+{
+	running = true;
+	clock->Resync();
+}
+
+void Machine::Stop()
+{
+	running = false;
+}
+
+uint64_t Machine::RunCycles(uint64_t cycles)
+{
+	// The CPU runs in slices that end on scheduler events, due events are handled in between
+
+	if (!running)
+		return 0;
+
+	uint64_t end = cpu->GetClockCount() + cycles;
+
+	while (cpu->GetClockCount() < end)
+	{
+		cpu->RunUntil(end, scheduler->NextEvent());
+		scheduler->Dispatch(cpu->GetClockCount());
+	}
+
+	return cycles;
+}
+
+uint64_t Machine::RunFrame()
+{
+	// The budget is taken from the clock even while stopped so guest time stays tied to frames,
+	// input is latched for the frame about to run
+
+	input->Latch(clock->GetFrames());
+	Control(input->GetLatched());
+
+	return RunCycles(clock->NextFrame());
+}
+
+void Machine::Control(const InputLog::FRAME& input)
+{
+	// The host's controls arrive with the latched input so a recording repeats them on the same frame
+
+	if (input.controls & InputLog::CONTROL_STOP)
+		Stop();
+
+	if (input.controls & InputLog::CONTROL_START)
+		Start();
+
+	Reset((input.controls & InputLog::CONTROL_RESET) != 0);
+
+	if (input.layer_toggles != 0)
+		video->SetEnabled(video->GetEnabled() ^ input.layer_toggles);
+
+	if (input.controls & InputLog::CONTROL_TRANSFORM)
+	{
+		for (uint32_t i = 0; i < InputLog::LAYERS; i++)
+		{
+			const InputLog::TRANSFORM& transform = input.transforms[i];
+
+			video->SetTransform(i, transform.scale_x, transform.scale_y, transform.angle, transform.origin_x, transform.origin_y, transform.centre_x, transform.centre_y);
+		}
+	}
+}
+
+void Machine::Reset(bool held)
+{
+	*RESB = held ? 0b0 : 0b1;
+}
+
+void Machine::PowerOn()
+{
+	// Starts the machine, holding RESB low for the two cycles the CPU needs to take the reset vector
+
+	Start();
+
+	Reset(true);
+	RunCycles(2);
+	Reset(false);
+}
+
+void Machine::SaveState(State& state)
+{
+	// Taken between RunCycles calls, the CPU may be part way through an instruction
+
+	state.Begin("MACH");
+	state.Put8(running);
+	state.End();
+
+	bus->SaveState(state);
+	cpu->SaveState(state);
+	ram->SaveState(state);
+	rom->SaveState(state);
+	mapper->SaveState(state);
+	video->SaveState(state);
+	video->GetPaletteRam()->SaveState(state);
+	timer->SaveState(state);
+	input->SaveState(state);
+	scheduler->SaveState(state);
+	clock->SaveState(state);
+}
+
+bool Machine::LoadState(State& state)
+{
+	// A state that fails part way leaves the machine in a mix of both, reset it before running
+
+	return LoadChunks(state, true);
+}
+
+bool Machine::LoadChanged(State& state)
+{
+	// For a state holding only the chunks that differ from the machine's own, the components
+	// without a chunk are left as they are
+
+	return LoadChunks(state, false);
+}
+
+bool Machine::LoadChunks(State& state, bool all)
+{
+	auto wanted = [&](const char* tag) { return all || state.Has(tag); };
+
+	if (wanted("MACH"))
+	{
+		if (!state.Find("MACH"))
+			return false;
+
+		running = state.Get8() != 0;
+
+		if (state.GetFailed())
+			return false;
+	}
+
+	return (!wanted("BUS ") || bus->LoadState(state)) &&
+		(!wanted("CPU ") || cpu->LoadState(state)) &&
+		(!wanted("RAM ") || ram->LoadState(state)) &&
+		(!wanted("ROM ") || rom->LoadState(state)) &&
+		(!wanted("MAPR") || mapper->LoadState(state)) &&
+		(!wanted("VID ") || video->LoadState(state)) &&
+		(!wanted("PAL ") || video->GetPaletteRam()->LoadState(state)) &&
+		(!wanted("TIMR") || timer->LoadState(state)) &&
+		(!wanted("INPT") || input->LoadState(state)) &&
+		(!wanted("SCHD") || scheduler->LoadState(state)) &&
+		(!wanted("CLCK") || clock->LoadState(state));
+}
+
+bool Machine::SaveState(std::string filename, bool compress)
+{
+	State state;
+
+	SaveState(state);
+
+	return state.Save(filename, compress);
+}
+
+bool Machine::LoadState(std::string filename)
+{
+	State state;
+
+	return state.Load(filename) && LoadState(state);
+}
+
+Bus::SharedPtr Machine::GetBus()
+{
+	return bus;
+}
+
+W65C816S::SharedPtr Machine::GetCPU()
+{
+	return cpu;
+}
+
+Video::SharedPtr Machine::GetVideo()
+{
+	return video;
+}
+
+Input::SharedPtr Machine::GetInput()
+{
+	return input;
+}
+
+MasterClock::SharedPtr Machine::GetClock()
+{
+	return clock;
+}
+
+Scheduler::SharedPtr Machine::GetScheduler()
+{
+	return scheduler;
+}
+
+bool Machine::GetRunning()
+{
+	return running;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "bus.h"
+#include "w65c816s.h"
+#include "ram.h"
+#include "rom.h"
+#include "mapper.h"
+#include "video.h"
+#include "masterclock.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "input.h"
+#include "state.h"
+
+// The emulated computer without any host front end
+// through the engine (debug output needs it). The CPU is stepped on the calling thread, one
+// emulated frame worth of master clock cycles at a time.
+
+class Machine
+{
+public:
+	typedef std::shared_ptr<Machine> SharedPtr;
+
+	typedef struct
+	{
+		uint32_t ram_start;
+		uint32_t ram_end;
+		uint32_t rom_start;			// the ROM image is loaded here
+		uint32_t rom_end;
+		Mapper::TYPE mapper_type;
+		uint32_t mapper_start;		// banked window
+		uint32_t mapper_window;
+		uint32_t mapper_register;	// bank select
+		uint32_t mapper_length;		// backing store
+	} MAP;
+
+private:
+	Bus::SharedPtr bus;
+	W65C816S::SharedPtr cpu;
+	Ram::SharedPtr ram;
+	Rom::SharedPtr rom;
+	Mapper::SharedPtr mapper;
+	Video::SharedPtr video;
+	Timer::SharedPtr timer;
+	Input::SharedPtr input;
+
+	MasterClock::SharedPtr clock;
+	Scheduler::SharedPtr scheduler;
+	bool running;
+
+	Bus::Line1Bit RESB;
+
+	bool LoadChunks(State& state, bool all);
+	void Control(const InputLog::FRAME& input);
+
+public:
+	Machine(uint32_t display_width, uint32_t display_height, const MAP& map = DefaultMap());
+	~Machine();
+
+	static MAP DefaultMap();
+
+	bool Load(std::string filename);
+	bool LoadBanks(std::string filename);
+	void Demo();
+
+	void Start();
+	void Stop();
+
+	uint64_t RunCycles(uint64_t cycles);
+	uint64_t RunFrame();
+	void Reset(bool held);
+	void PowerOn();
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+	bool LoadChanged(State& state);
+	bool SaveState(std::string filename, bool compress);
+	bool LoadState(std::string filename);
+
+	Bus::SharedPtr GetBus();
+	W65C816S::SharedPtr GetCPU();
+	Video::SharedPtr GetVideo();
+	Input::SharedPtr GetInput();
+	MasterClock::SharedPtr GetClock();
+	Scheduler::SharedPtr GetScheduler();
+	bool GetRunning();
+
+};
@@ -0,0 +1,177 @@
+#include "mapper.h"
+
+Mapper::Mapper(Bus* bus, TYPE type, uint32_t startAddress, uint32_t windowSize, uint32_t registerAddress, uint32_t length)
+{
+	this->bus = bus;
+	this->type = type;
+	this->startAddress = startAddress;
+	this->endAddress = startAddress + windowSize - 1;
+	this->windowSize = windowSize;
+	this->registerAddress = registerAddress;
+	this->length = length;
+
+	// An invalid layout leaves a mapper with no banks that answers no address
+
+	if (!Valid(startAddress, windowSize, registerAddress, length))
+	{
+		std::cout << "Mapper::Mapper() : invalid window " << std::hex << startAddress << " size " << windowSize << " register " << registerAddress << " length " << length << std::dec << std::endl;
+
+		this->endAddress = startAddress;
+		this->length = 0;
+	}
+
+	banks = (this->length != 0) ? this->length / windowSize : 0;
+	bank = 0;
+
+	store = std::make_unique<uint8_t[]>(this->length);
+
+	Reset();
+}
+
+bool Mapper::Valid(uint32_t startAddress, uint32_t windowSize, uint32_t registerAddress, uint32_t length)
+{
+	// The window is mapped as whole bus pages inside the 24 bit address space, the bank select
+	// register reaches at most 0x10000 banks. Neither register byte may fall in the window, a RAM
+	// window's direct write pointer would take the writes and the bank could never change.
+
+	if (windowSize == 0 || (windowSize & Bus::PAGE_MASK) != 0 || (startAddress & Bus::PAGE_MASK) != 0)
+		return false;
+
+	if ((uint64_t)startAddress + windowSize > 0x1000000 || registerAddress >= 0xffffff)
+		return false;
+
+	if ((uint64_t)registerAddress + 1 >= startAddress && registerAddress < (uint64_t)startAddress + windowSize)
+		return false;
+
+	return length >= windowSize && length / windowSize <= 0xffff;
+}
+
+Mapper::~Mapper()
+{
+}
+
+void Mapper::Reset()
+{
+	for (uint32_t i = 0; i < length; i++)
+		store[i] = rand() % 256;
+
+	SelectBank(0);
+}
+
+bool Mapper::Load(std::string filename)
+{
+	std::ifstream romfile;
+
+	romfile.open(filename, std::ios::binary | std::ios::in);
+
+	if (!romfile.is_open())
+	{
+		std::cout << "Mapper::Load() : cannot open " << filename << std::endl;
+		return false;
+	}
+
+	romfile.read((char*)store.get(), length);
+
+	romfile.close();
+
+	return true;
+}
+
+void Mapper::SelectBank(uint16_t bank)
+{
+	// Only the page table entries for the window change, the backing store is never copied
+
+	if (banks == 0)
+		return;
+
+	this->bank = bank % banks;
+
+	uint8_t* window = &store[this->bank * windowSize];
+
+	if (type == TYPE::RAM)
+		bus->MapPages(startAddress, endAddress, window, window, this);
+	else
+		bus->MapPages(startAddress, endAddress, window, nullptr, this);
+}
+
+uint16_t Mapper::GetBank()
+{
+	return bank;
+}
+
+void Mapper::SaveState(State& state)
+{
+	state.Begin("MAPR");
+	state.Put32(length);
+	state.Put16(bank);
+	state.PutBytes(store.get(), length);
+	state.End();
+}
+
+bool Mapper::LoadState(State& state)
+{
+	if (!state.Find("MAPR") || state.Get32() != length)
+		return false;
+
+	uint16_t saved_bank = state.Get16();
+
+	if (!state.GetBytes(store.get(), length))
+		return false;
+
+	SelectBank(saved_bank);
+
+	return true;
+}
+
+bool Mapper::ValidWrite(uint32_t address)
+{
+	if (banks == 0)
+		return false;
+
+	if (address == registerAddress || address == registerAddress + 1)
+		return true;
+
+	if (type == TYPE::RAM && address >= startAddress && address <= endAddress)
+		return true;
+
+	return false;
+}
+
+bool Mapper::ValidRead(uint32_t address)
+{
+	if (banks == 0)
+		return false;
+
+	if (address == registerAddress || address == registerAddress + 1)
+		return true;
+
+	if (address >= startAddress && address <= endAddress)
+		return true;
+
+	return false;
+}
+
+void Mapper::Write(uint32_t address, uint8_t data)
+{
+	if (address == registerAddress)
+		SelectBank((bank & 0xff00) | data);
+	else if (address == registerAddress + 1)
+		SelectBank((bank & 0x00ff) | (data << 8));
+	else if (type == TYPE::RAM && address >= startAddress && address <= endAddress)
+		store[(bank * windowSize) + (address - startAddress)] = data;
+}
+
+uint8_t Mapper::Read(uint32_t address)
+{
+	if (address == registerAddress)
+		return bank & 0x00ff;
+
+	if (address == registerAddress + 1)
+		return bank >> 8;
+
+	return store[(bank * windowSize) + (address - startAddress)];
+}
+
+void Mapper::Debug()
+{
+}
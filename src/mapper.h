@@ -0,0 +1,61 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <iomanip>
+#include <bitSet>
+
+#include "bus.h"
+#include "state.h"
+
+class Mapper : public BusDevice
+{
+public:
+	typedef std::shared_ptr<Mapper> SharedPtr;
+
+	enum class TYPE
+	{
+		ROM = 0,
+		RAM = 1,
+	};
+
+private:
+	Bus* bus;
+	TYPE type;
+
+	uint32_t startAddress;		// first address of the visible window
+	uint32_t endAddress;		// last address of the visible window
+	uint32_t windowSize;		// 0x8000 (32 KB) or 0x10000 (64 KB)
+	uint32_t registerAddress;	// bank select low byte, high byte at registerAddress + 1
+
+	uint32_t length;			// size of the backing store
+	uint16_t banks;				// number of windowSize banks in the backing store
+	uint16_t bank;				// currently selected bank
+
+	std::unique_ptr<uint8_t[]> store; // pointer to backing storage
+
+public:
+	Mapper(Bus* bus, TYPE type, uint32_t startAddress, uint32_t windowSize, uint32_t registerAddress, uint32_t length);
+	~Mapper();
+
+	static bool Valid(uint32_t startAddress, uint32_t windowSize, uint32_t registerAddress, uint32_t length);
+
+	void Reset();
+
+	bool Load(std::string filename);
+
+	void SelectBank(uint16_t bank);
+	uint16_t GetBank();
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	bool ValidWrite(uint32_t address) override;
+	bool ValidRead(uint32_t address) override;
+	void Write(uint32_t address, uint8_t data) override;
+	uint8_t Read(uint32_t address) override;
+
+	void Debug();
+};
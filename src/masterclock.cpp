@@ -0,0 +1,121 @@
+#include "masterclock.h"
+
+MasterClock::MasterClock(uint64_t frequency, uint32_t frame_rate)
+{
+	this->frequency = std::max<uint64_t>(1, frequency);
+	this->frame_rate = std::max<uint32_t>(1, frame_rate);
+
+	remainder = 0;
+	cycles = 0;
+	frames = 0;
+
+	Resync();
+}
+
+MasterClock::~MasterClock()
+{
+}
+
+void MasterClock::SetFrequency(uint64_t frequency)
+{
+	this->frequency = std::max<uint64_t>(1, frequency);
+}
+
+uint64_t MasterClock::GetFrequency()
+{
+	return frequency;
+}
+
+uint32_t MasterClock::GetFrameRate()
+{
+	return frame_rate;
+}
+
+uint64_t MasterClock::NextFrame()
+{
+	// Cycle budget of the next emulated frame, exact over any number of frames
+
+	remainder += frequency;
+
+	uint64_t budget = remainder / frame_rate;
+
+	remainder %= frame_rate;
+
+	cycles += budget;
+	++frames;
+
+	return budget;
+}
+
+uint64_t MasterClock::PeekFrame()
+{
+	// The budget NextFrame will hand out, without taking it
+
+	return (remainder + frequency) / frame_rate;
+}
+
+uint32_t MasterClock::FramesDue()
+{
+	// Emulated frames owed to wall time since the last call. A host that falls behind (window drag,
+	// debugger) catches up by at most MAX_CATCH_UP frames instead of running the backlog at once.
+
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - paced_start).count();
+	uint64_t expected = (elapsed / 1000000000ull) * frame_rate + ((elapsed % 1000000000ull) * frame_rate) / 1000000000ull;
+	uint64_t due = expected - paced_frames;
+
+	paced_frames = expected;
+
+	return (uint32_t)std::min<uint64_t>(due, MAX_CATCH_UP);
+}
+
+void MasterClock::Resync()
+{
+	paced_start = std::chrono::steady_clock::now();
+	paced_frames = 0;
+}
+
+void MasterClock::SaveState(State& state)
+{
+	state.Begin("CLCK");
+	state.Put64(frequency);
+	state.Put32(frame_rate);
+	state.Put64(remainder);
+	state.Put64(cycles);
+	state.Put64(frames);
+	state.End();
+}
+
+bool MasterClock::LoadState(State& state)
+{
+	// Pacing starts again from the load, wall time does not carry over
+
+	if (!state.Find("CLCK"))
+		return false;
+
+	frequency = std::max<uint64_t>(1, state.Get64());
+	frame_rate = std::max<uint32_t>(1, state.Get32());
+	remainder = state.Get64();
+	cycles = state.Get64();
+	frames = state.Get64();
+
+	Resync();
+
+	return !state.GetFailed();
+}
+
+uint64_t MasterClock::GetCycles()
+{
+	return cycles;
+}
+
+uint64_t MasterClock::GetFrames()
+{
+	return frames;
+}
+
+double MasterClock::GetTime()
+{
+	// Guest seconds elapsed
+
+	return (double)cycles / (double)frequency;
+}
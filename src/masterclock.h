@@ -0,0 +1,53 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "state.h"
+
+// Guest time base: the CPU clock in Hz is handed out as whole cycle budgets per emulated frame, the
+// remainder carried so frequency / frame_rate cycles are run per frame on average. Wall time only
+// decides how many emulated frames are due, never how long one is.
+
+class MasterClock
+{
+public:
+	typedef std::shared_ptr<MasterClock> SharedPtr;
+
+	static const uint64_t FREQUENCY = 4000000;	// default CPU clock, Hz
+	static const uint32_t FRAME_RATE = 60;		// emulated frames per second
+	static const uint32_t MAX_CATCH_UP = 4;		// frames run at most per FramesDue, time beyond is dropped
+
+private:
+	uint64_t frequency;
+	uint32_t frame_rate;
+
+	uint64_t remainder;		// frequency * frames not yet handed out, in cycles * frame_rate
+	uint64_t cycles;		// cycles handed out since construction
+	uint64_t frames;		// emulated frames handed out
+
+	std::chrono::steady_clock::time_point paced_start;
+	uint64_t paced_frames;	// frames due since paced_start that were already returned by FramesDue
+
+public:
+	MasterClock(uint64_t frequency = FREQUENCY, uint32_t frame_rate = FRAME_RATE);
+	~MasterClock();
+
+	void SetFrequency(uint64_t frequency);
+	uint64_t GetFrequency();
+	uint32_t GetFrameRate();
+
+	uint64_t NextFrame();
+	uint64_t PeekFrame();
+	uint32_t FramesDue();
+	void Resync();
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	uint64_t GetCycles();
+	uint64_t GetFrames();
+	double GetTime();
+};
@@ -3,325 +3,285 @@
 
 #include "moon.h"
 
-Moon::Moon()
+// Looked for in the working directory unless --rom names another image
+static const std::string ROM_PATH = "test.bin";
+
+static bool Boot(Machine::SharedPtr machine, std::string rom_path)
 {
-	sAppName = "Moon";
+	if (!machine->Load(rom_path))
+		return false;
+
+	machine->Demo();
+	machine->PowerOn();
+
+	return true;
+}
+
+static std::string TakeOption(int& argc, char* argv[], std::string name, std::string value)
+{
+	// Removes "name value" from the arguments, returning value or the default when it is not there
+
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (name == argv[i])
+		{
+			value = argv[i + 1];
 
-	bus = std::make_shared<Bus>(this);
-	cpu = std::make_shared<W65C816S>(bus, this);
-	ram = std::make_shared<Ram>(this, 0x000000, 0x007fff);
-	rom = std::make_shared<Rom>(this, 0x008000, 0x0080ff);
+			for (int j = i; j + 2 <= argc; j++)
+				argv[j] = argv[j + 2];
 
-	PHI2 = bus->AttachLine1Bit("PHI2");
-	RESB = bus->AttachLine1Bit("RESB");
+			argc -= 2;
+			break;
+		}
+	}
 
-	bus->AddDevice(ram);
-	bus->AddDevice(rom);
+	return value;
+}
 
-	rom->Load("E:\\Scott Moore\\Workspace\\github.com\\div-int\\moon\\src\\test.bin");
+Moon::Moon()
+{
+	sAppName = "Moon";
+	rom_path = ROM_PATH;
 }
 
 Moon::~Moon()
 {
 }
 
-bool Moon::OnUserCreate()
+void Moon::SetRom(std::string path)
+{
+	rom_path = path;
+}
+
+void Moon::SetRecord(std::string path)
 {
-	bus->Start();
-	cpu->Start();
+	// Every emulated frame's input is logged from the boot state on and saved when the window closes
 
-	pixel_x = 0;
-	pixel_y = 0;
+	record_path = path;
+}
 
+bool Moon::OnUserCreate()
+{
 	display_scale = 2;
 	display_width = ScreenWidth() / display_scale;
 	display_height = ScreenHeight() / display_scale;
-	display_size = display_width * display_height;
 
 	display_buffer = new olc::Sprite(display_width, display_height);
 
-	screen_buffer_0 = new uint8_t[1024 * 1024];
-	screen_buffer_1 = new uint8_t[1024 * 1024];
-	screen_buffer_2 = new uint8_t[1024 * 1024];
-	screen_buffer_3 = new uint8_t[1024 * 1024];
+	show_debug = true;
+	turbo = false;
 
-	sprite_buffer = new uint8_t[1024 * 1024];
+	layer_zoom_x = 1.0f;
+	layer_zoom_y = 1.0f;
+	layer_angle = 0.0f;
 
-	for (uint32_t i = 0; i < (1024 * 1024); i++)
-	{
-		screen_buffer_0[i] = (((i / (32 * 1024)) + (i / 32)) % 2) * ((i + (i / 1024)) % 256);
-		screen_buffer_1[i] = (((i / (16 * 1024)) + (i / 16)) % 2) * ((i / 2) % 256);
-		screen_buffer_2[i] = (((i / (8 * 1024)) + (i / 8)) % 2) * ((i / 1) % 256);
-		screen_buffer_3[i] = ((i / 1024) % 256);
-	}
+	machine = std::make_shared<Machine>(display_width, display_height);
+	video = machine->GetVideo();
+	overlay = std::make_shared<Overlay>(this);
+
+	if (!Boot(machine, rom_path))
+		return false;
 
-	pixel_x_start_0 = 0;
-	pixel_y_start_0 = 0;
-	pixel_x_start_1 = 0;
-	pixel_y_start_1 = 0;
-	pixel_x_start_2 = 0;
-	pixel_y_start_2 = 0;
-	pixel_x_start_3 = 0;
-	pixel_y_start_3 = 0;
-
-	pixel_x_scale_0 = 0x10000;
-	pixel_y_scale_0 = 0x10000;
-	pixel_x_scale_1 = 0x10000;
-	pixel_y_scale_1 = 0x10000;
-	pixel_x_scale_2 = 0x10000;
-	pixel_y_scale_2 = 0x10000;
-	pixel_x_scale_3 = 0x10000;
-	pixel_y_scale_3 = 0x10000;
-
-	screen_buffer_enabled = 0b1111;
-
-	for (int i = 0; i < 256; i++)
+	if (!record_path.empty())
 	{
-		auto r = 0;// ((i / 64) * 4) % 16;
-		auto g = 0;// ((i / 32) * 4) % 16;
-		auto b = 0x0f;// ((i / 16) * 4) % 16;
-		auto l = i % 16;
+		State state;
 
-		palette_buffer_0[i] = (r << 12) | (g << 8) | (b << 4) | l;
+		machine->SaveState(state);
+
+		input_log = std::make_shared<InputLog>();
+		input_log->Clear(machine->GetClock()->GetFrames());
+		input_log->SetStartState(state);
+
+		machine->GetInput()->Record(input_log);
+
+		replay = std::make_shared<Replay>(machine, input_log);
 	}
 
+	throughput = std::make_shared<Throughput>(machine);
+	rewind = std::make_shared<Rewind>(machine);
+
 	return true;
 }
 
 bool Moon::OnUserDestroy()
 {
-	// TO DO
+	if (input_log && !input_log->Save(record_path))
+		std::cout << "Failed to save input log " << record_path << std::endl;
 
 	return true;
 }
 
-bool Moon::OnUserUpdate(float fElapsedTime)
+InputLog::FRAME Moon::HostInput()
 {
-	SetDrawTarget(display_buffer);
+	// Mouse position in screen pixels, buttons 0 - 2 and every olc::Key
+
+	InputLog::FRAME input = InputLog::Empty();
 
-	pixel_x = 0;
-	pixel_y = 0;
+	input.mouse_x = (uint16_t)GetMouseX();
+	input.mouse_y = (uint16_t)GetMouseY();
 
-	pixel_x_start_0 = (-GetMouseX() << 15) & 0x3ffffff;
-	pixel_y_start_0 = (-GetMouseY() << 15) & 0x3ffffff;
+	for (uint32_t button = 0; button < 3; button++)
+		input.buttons |= GetMouse(button).bHeld ? (1 << button) : 0;
 
-	pixel_x_start_1 = (-GetMouseX() << 14) & 0x3ffffff;
-	pixel_y_start_1 = (-GetMouseY() << 14) & 0x3ffffff;
+	for (uint32_t key = olc::Key::NONE + 1; key <= olc::Key::NP_DECIMAL; key++)
+	{
+		if (GetKey((olc::Key)key).bHeld)
+			input.keys[key / 8] |= 1 << (key % 8);
+	}
 
-	pixel_x_start_2 = (-GetMouseX() << 13) & 0x3ffffff;
-	pixel_y_start_2 = (-GetMouseY() << 13) & 0x3ffffff;
+	return input;
+}
 
-	pixel_x_start_3 = (-GetMouseX() << 12) & 0x3ffffff;
-	pixel_y_start_3 = (-GetMouseY() << 12) & 0x3ffffff;
+bool Moon::OnUserUpdate(float fElapsedTime)
+{
+	// The host's controls of the machine go with the input latched for the next frame, so they are
+	// recorded with it. Each layer turns about the screen centre, the mouse pans them at different
+	// rates.
 
-	pixel_x_0 = pixel_x_start_0 & 0x3ffffff;
-	pixel_y_0 = pixel_y_start_0 & 0x3ffffff;
+	InputLog::FRAME input = HostInput();
 
-	pixel_x_1 = pixel_x_start_1 & 0x3ffffff;
-	pixel_y_1 = pixel_y_start_1 & 0x3ffffff;
+	float centre_x = display_width / 2.0f;
+	float centre_y = display_height / 2.0f;
 
-	pixel_x_2 = pixel_x_start_2 & 0x3ffffff;
-	pixel_y_2 = pixel_y_start_2 & 0x3ffffff;
+	for (uint32_t i = 0; i < Video::LAYERS; i++)
+	{
+		float parallax = 0.5f / (1 << i);
+		float direction = (i & 1) ? -1.0f : 1.0f;
 
-	pixel_x_3 = pixel_x_start_3 & 0x3ffffff;
-	pixel_y_3 = pixel_y_start_3 & 0x3ffffff;
+		input.transforms[i] = { layer_zoom_x, layer_zoom_y, direction * layer_angle / (i + 1), centre_x - (GetMouseX() * parallax), centre_y - (GetMouseY() * parallax), centre_x, centre_y };
+	}
 
-	//if (GetKey(olc::Key::SPACE).bReleased)
-		*PHI2 = ~(*PHI2);
+	input.controls |= InputLog::CONTROL_TRANSFORM;
 
 	if (GetKey(olc::Key::Q).bReleased)
-		cpu->Stop();
+		input.controls |= InputLog::CONTROL_STOP;
 
 	if (GetKey(olc::Key::S).bReleased)
-		cpu->Start();
+		input.controls |= InputLog::CONTROL_START;
 
 	if (GetKey(olc::Key::R).bHeld)
-		*RESB = 0b0;
-	else
-		*RESB = 0b1;
-
-	if (GetKey(olc::Key::ESCAPE).bReleased)
-		return false;
+		input.controls |= InputLog::CONTROL_RESET;
 
 	if (GetKey(olc::Key::K1).bPressed)
-		screen_buffer_enabled ^= 0b0001;
+		input.layer_toggles ^= 0b0001;
 	if (GetKey(olc::Key::K2).bPressed)
-		screen_buffer_enabled ^= 0b0010;
+		input.layer_toggles ^= 0b0010;
 	if (GetKey(olc::Key::K3).bPressed)
-		screen_buffer_enabled ^= 0b0100;
+		input.layer_toggles ^= 0b0100;
 	if (GetKey(olc::Key::K4).bPressed)
-		screen_buffer_enabled ^= 0b1000;
+		input.layer_toggles ^= 0b1000;
 
-	if (GetKey(olc::Key::RIGHT).bHeld)
-	{
-		pixel_x_scale_0 += 0x100;
-		pixel_x_scale_1 += 0x100;
-		pixel_x_scale_2 += 0x100;
-		pixel_x_scale_3 += 0x100;
-	}
-	if (GetKey(olc::Key::LEFT).bHeld)
-	{
-		pixel_x_scale_0 -= 0x100;
-		pixel_x_scale_1 -= 0x100;
-		pixel_x_scale_2 -= 0x100;
-		pixel_x_scale_3 -= 0x100;
-	}
-	if (GetKey(olc::Key::UP).bHeld)
+	machine->GetInput()->SetPending(input);
+
+	// Guest time follows the master clock, a slow host frame runs several emulated frames. Turbo
+	// runs emulated frames for a whole host frame period and only the last one is rendered, it is
+	// not recorded for rewind. Holding backspace steps back one rewind entry per host frame. A
+	// recording takes its replay checkpoints from every frame run.
+
+	if (GetKey(olc::Key::BACK).bHeld)
 	{
-		pixel_y_scale_0 += 0x100;
-		pixel_y_scale_1 += 0x100;
-		pixel_y_scale_2 += 0x100;
-		pixel_y_scale_3 += 0x100;
+		rewind->Back();
 	}
-	if (GetKey(olc::Key::DOWN).bHeld)
+	else if (turbo)
 	{
-		pixel_y_scale_0 -= 0x100;
-		pixel_y_scale_1 -= 0x100;
-		pixel_y_scale_2 -= 0x100;
-		pixel_y_scale_3 -= 0x100;
-	}
+		auto start = std::chrono::steady_clock::now();
+		auto period = std::chrono::nanoseconds(1000000000 / machine->GetClock()->GetFrameRate());
 
-	auto pixel_colour = olc::VERY_DARK_GREY;
-	uint32_t offset;
-	uint32_t pixel_lookup;
+		do
+		{
+			machine->RunFrame();
 
-	for (uint32_t i = 0; i < display_size; i++)
+			if (replay)
+				replay->Frame();
+		} while (std::chrono::steady_clock::now() - start < period);
+	}
+	else
 	{
-		pixel_colour = olc::VERY_DARK_YELLOW;
-
-		if (screen_buffer_enabled & 0b0001)
-		{
-			offset = (pixel_x_0 >> 16) + ((pixel_y_0 >> 16) << 10);
-			pixel_lookup = screen_buffer_0[offset];
-		}
-		else
+		for (uint32_t frames = machine->GetClock()->FramesDue(); frames > 0; frames--)
 		{
-			pixel_lookup = 0x00;
-		}
+			machine->RunFrame();
+			rewind->Frame();
 
-		if (pixel_lookup != 0x00)
-		{
-			pixel_colour.r = ((palette_buffer_0[pixel_lookup] & 0xf000) >> 8) + (palette_buffer_0[pixel_lookup] & 0x000f);
-			pixel_colour.g = ((palette_buffer_0[pixel_lookup] & 0x0f00) >> 4) + (palette_buffer_0[pixel_lookup] & 0x000f);
-			pixel_colour.b = (palette_buffer_0[pixel_lookup] & 0x00f0) + (palette_buffer_0[pixel_lookup] & 0x000f);
-		}
-		else
-		{
-			if (screen_buffer_enabled & 0b0010)
-			{
-				offset = (pixel_x_1 >> 16) + ((pixel_y_1 >> 16) << 10);
-				pixel_lookup = screen_buffer_1[offset];
-			}
-			else
-			{
-				pixel_lookup = 0x00;
-			}
-
-			if (pixel_lookup != 0x00)
-			{
-				pixel_colour.r = ((palette_buffer_0[pixel_lookup] & 0xf000) >> 8) + (palette_buffer_0[pixel_lookup] & 0x000f);
-				pixel_colour.g = ((palette_buffer_0[pixel_lookup] & 0x0f00) >> 4) + (palette_buffer_0[pixel_lookup] & 0x000f);
-				pixel_colour.b = (palette_buffer_0[pixel_lookup] & 0x00f0) + (palette_buffer_0[pixel_lookup] & 0x000f);
-			}
-			else
-			{
-				if (screen_buffer_enabled & 0b0100)
-				{
-					offset = (pixel_x_2 >> 16) + ((pixel_y_2 >> 16) << 10);
-					pixel_lookup = screen_buffer_2[offset];
-				}
-				else
-				{
-					pixel_lookup = 0x00;
-				}
-
-				if (pixel_lookup != 0x00)
-				{
-					pixel_colour.r = ((palette_buffer_0[pixel_lookup] & 0xf000) >> 8) + (palette_buffer_0[pixel_lookup] & 0x000f);
-					pixel_colour.g = ((palette_buffer_0[pixel_lookup] & 0x0f00) >> 4) + (palette_buffer_0[pixel_lookup] & 0x000f);
-					pixel_colour.b = (palette_buffer_0[pixel_lookup] & 0x00f0) + (palette_buffer_0[pixel_lookup] & 0x000f);
-				}
-				else
-				{
-					if (screen_buffer_enabled & 0b1000)
-					{
-						offset = (pixel_x_3 >> 16) + ((pixel_y_3 >> 16) << 10);
-						pixel_lookup = screen_buffer_3[offset];
-					}
-					else
-					{
-						pixel_lookup = 0x00;
-					}
-
-					if (pixel_lookup != 0x00)
-					{
-						pixel_colour.r = ((palette_buffer_0[pixel_lookup] & 0xf000) >> 8) + (palette_buffer_0[pixel_lookup] & 0x000f);
-						pixel_colour.g = ((palette_buffer_0[pixel_lookup] & 0x0f00) >> 4) + (palette_buffer_0[pixel_lookup] & 0x000f);
-						pixel_colour.b = (palette_buffer_0[pixel_lookup] & 0x00f0) + (palette_buffer_0[pixel_lookup] & 0x000f);
-					}
-				}
-			}
+			if (replay)
+				replay->Frame();
 		}
+	}
 
-		Draw(pixel_x, pixel_y, pixel_colour);
-
-		++pixel_x;
+	if (GetKey(olc::Key::ESCAPE).bReleased)
+		return false;
 
-		if (pixel_x >= display_width)
-		{
-			pixel_x = 0;
+	if (GetKey(olc::Key::RIGHT).bHeld)
+		layer_zoom_x *= 1.01f;
+	if (GetKey(olc::Key::LEFT).bHeld)
+		layer_zoom_x /= 1.01f;
+	if (GetKey(olc::Key::UP).bHeld)
+		layer_zoom_y *= 1.01f;
+	if (GetKey(olc::Key::DOWN).bHeld)
+		layer_zoom_y /= 1.01f;
 
-			++pixel_y;
+	if (GetKey(olc::Key::D).bPressed)
+		show_debug = !show_debug;
 
-			pixel_x_0 = pixel_x_start_0;
-			pixel_x_1 = pixel_x_start_1;
-			pixel_x_2 = pixel_x_start_2;
-			pixel_x_3 = pixel_x_start_3;
+	if (GetKey(olc::Key::T).bPressed)
+	{
+		turbo = !turbo;
+		machine->GetClock()->Resync();
+		throughput->Reset();
+	}
 
-			pixel_y_0 += pixel_y_scale_0;
-			pixel_y_1 += pixel_y_scale_1;
-			pixel_y_2 += pixel_y_scale_2;
-			pixel_y_3 += pixel_y_scale_3;
-		}
+	if (throughput->GetElapsed() >= 1.0)
+	{
+		throughput_text = (turbo ? "TURBO " : "") + Throughput::Format(throughput->Sample());
+		throughput->Reset();
+	}
 
-		pixel_x_0 += pixel_x_scale_0;
-		pixel_x_1 += pixel_x_scale_1;
-		pixel_x_2 += pixel_x_scale_2;
-		pixel_x_3 += pixel_x_scale_3;
-
-		pixel_x_0 &= 0x3ffffff;
-		pixel_y_0 &= 0x3ffffff;
-		pixel_x_1 &= 0x3ffffff;
-		pixel_y_1 &= 0x3ffffff;
-		pixel_x_2 &= 0x3ffffff;
-		pixel_y_2 &= 0x3ffffff;
-		pixel_x_3 &= 0x3ffffff;
-		pixel_y_3 &= 0x3ffffff;
+	if (GetKey(olc::Key::C).bPressed)
+	{
+		if (capture)
+			capture.reset();
+		else
+			capture = std::make_shared<Capture>(display_width, display_height, Capture::FORMAT::Y4M, "moon.y4m");
 	}
 
-	pixel_x_start_0 += pixel_x_scale_0;
-	pixel_x_start_1 -= pixel_x_scale_1;
-	pixel_y_start_2 += pixel_y_scale_2;
-	pixel_y_start_3 -= pixel_y_scale_3;
+	bool frame_changed = video->Render((uint32_t*)display_buffer->GetData());
+
+	if (capture)
+		capture->Submit((const uint32_t*)display_buffer->GetData());
 
-	pixel_y_start_0 += pixel_x_scale_0 >> 1;
-	pixel_y_start_1 -= pixel_x_scale_1 >> 1;
-	pixel_x_start_2 += pixel_y_scale_2 >> 1;
-	pixel_x_start_3 -= pixel_y_scale_3 >> 1;
+	layer_angle += fElapsedTime * 0.5f;
 
-	SetDrawTarget(nullptr);
-	DrawSprite(0, 0, display_buffer, display_scale);
+	// An unchanged frame is only uploaded again when the debug text has to be drawn over it
 
-	bus->Debug();
-	cpu->Debug();
+	if (frame_changed || show_debug)
+		DrawSprite(0, 0, display_buffer, display_scale);
+
+	if (show_debug)
+	{
+		overlay->SetText(0, 8, 8 + (0 * 8), machine->GetBus()->Debug());
+		overlay->SetText(1, 8, 8 + (9 * 8), machine->GetCPU()->Debug());
+		overlay->SetText(2, 8, ScreenHeight() - 16, throughput_text);
+		overlay->Draw();
+	}
 
 	return true;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+	// moon [--rom <image>] [--record <log>] boots the ROM image, test.bin by default, in a window.
+	// Headless runs, replays and seeking are moon-run's.
+
+	std::string rom_path = TakeOption(argc, argv, "--rom", ROM_PATH);
+
+	// moon --record <log> runs the window as normal and saves its input log on exit
+
 	Moon moon;
 
+	moon.SetRom(rom_path);
+
+	if (argc > 2 && std::string(argv[1]) == "--record")
+		moon.SetRecord(argv[2]);
+
 	if (moon.Construct(848, 480, 2, 2, false, false))
 		moon.Start();
 
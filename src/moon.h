@@ -4,13 +4,16 @@
 #pragma once
 
 #include <iostream>
+#include <chrono>
 
-#include "bus.h"
-#include "w65c816s.h"
-#include "ram.h"
-#include "rom.h"
+#include "machine.h"
+#include "capture.h"
+#include "throughput.h"
+#include "rewind.h"
+#include "inputlog.h"
+#include "replay.h"
+#include "overlay.h"
 
-#define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
 
 const int OK = 0;
@@ -18,81 +21,34 @@ const int FAIL = -1;
 
 class Moon : public olc::PixelGameEngine
 {
-public:
-	class Sprite {
-	public:
-		uint32_t pixel_x;
-		uint32_t pixel_y;
-		uint32_t buffer_x;
-		uint32_t buffer_y;
-		uint32_t buffer_width;
-		uint32_t buffer_height;
-		uint32_t* palette_ptr;
-	};
-
 private:
-	Bus::SharedPtr bus;
-	W65C816S::SharedPtr cpu;
-	Ram::SharedPtr ram;
-	Rom::SharedPtr rom;
-
-	Bus::Line1Bit PHI2;
-	Bus::Line1Bit RESB;
-
-	uint32_t pixel_x;
-	uint32_t pixel_y;
+	Machine::SharedPtr machine;
+	Video::SharedPtr video;
+	Capture::SharedPtr capture;
+	Overlay::SharedPtr overlay;
+	Throughput::SharedPtr throughput;
+	Rewind::SharedPtr rewind;
+	InputLog::SharedPtr input_log;
+	Replay::SharedPtr replay;
 
 	uint32_t display_scale;
 	uint32_t display_width;
 	uint32_t display_height;
-	uint32_t display_size;
 
 	olc::Sprite* display_buffer;
 
-	uint32_t pixel_x_0;
-	uint32_t pixel_y_0;
-	uint32_t pixel_x_1;
-	uint32_t pixel_y_1;
-	uint32_t pixel_x_2;
-	uint32_t pixel_y_2;
-	uint32_t pixel_x_3;
-	uint32_t pixel_y_3;
-
-	uint32_t pixel_x_start_0;
-	uint32_t pixel_y_start_0;
-	uint32_t pixel_x_start_1;
-	uint32_t pixel_y_start_1;
-	uint32_t pixel_x_start_2;
-	uint32_t pixel_y_start_2;
-	uint32_t pixel_x_start_3;
-	uint32_t pixel_y_start_3;
-
-	uint32_t pixel_x_scale_0;
-	uint32_t pixel_y_scale_0;
-	uint32_t pixel_x_scale_1;
-	uint32_t pixel_y_scale_1;
-	uint32_t pixel_x_scale_2;
-	uint32_t pixel_y_scale_2;
-	uint32_t pixel_x_scale_3;
-	uint32_t pixel_y_scale_3;
-
-	uint8_t* screen_buffer_0;
-	uint8_t* screen_buffer_1;
-	uint8_t* screen_buffer_2;
-	uint8_t* screen_buffer_3;
-
-	uint16_t palette_buffer_0[256];
-
-	uint8_t screen_buffer_enabled;
-
-	uint8_t* sprite_buffer;
-
-	uint32_t* screen_palette_0;
-	uint32_t* screen_palette_1;
-	uint32_t* screen_palette_2;
-	uint32_t* screen_palette_3;
-
-	Sprite sprites[32];
+	bool show_debug;
+	bool turbo;
+	std::string throughput_text;
+
+	float layer_zoom_x;
+	float layer_zoom_y;
+	float layer_angle;
+
+	std::string rom_path;
+	std::string record_path;
+
+	InputLog::FRAME HostInput();
 
 protected:
 
@@ -100,6 +56,9 @@ public:
 	Moon();
 	~Moon();
 
+	void SetRom(std::string path);
+	void SetRecord(std::string path);
+
 	bool OnUserCreate() override;
 	bool Moon::OnUserDestroy() override;
 	bool OnUserUpdate(float fElapsedTime) override;
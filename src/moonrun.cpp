@@ -0,0 +1,378 @@
+// moonrun.cpp : Runs a ROM image headless at full speed and dumps the final machine state.
+//
+
+#include "moonrun.h"
+
+static const uint32_t DISPLAY_WIDTH = 424;
+static const uint32_t DISPLAY_HEIGHT = 240;
+static const uint64_t FRAMES = 60;
+
+typedef struct
+{
+	uint32_t start;
+	uint32_t end;
+} RANGE;
+
+static void Usage()
+{
+	std::cout << "moon-run <rom> [options]" << std::endl;
+	std::cout << std::endl;
+	std::cout << "  --ram <start>-<end>                  RAM addresses (hex), default 000000-007fff" << std::endl;
+	std::cout << "  --rom <start>-<end>                  ROM addresses the image is loaded at, default 008000-0080ff" << std::endl;
+	std::cout << "  --mapper <ram|rom>,<start>,<window>,<register>,<length>" << std::endl;
+	std::cout << "                                       banked window (hex), default ram,010000,8000,00c000,100000" << std::endl;
+	std::cout << "                                       start and window in whole 1000 byte pages" << std::endl;
+	std::cout << "  --banks <file>                       image loaded into the mapper's backing store" << std::endl;
+	std::cout << "  --demo                               fill the video layers with the test patterns, as moon does" << std::endl;
+	std::cout << "  --state <file>                       start from a saved machine state instead of booting <rom>" << std::endl;
+	std::cout << "  --replay <log>                       feed the input recorded in an input log, from its start state" << std::endl;
+	std::cout << "                                       if it has one, for all its frames unless --frames is given, and fail" << std::endl;
+	std::cout << "                                       when the run does not match a checkpoint the log recorded" << std::endl;
+	std::cout << "  --seek <frame>                       start the replay at an emulated frame, through the log's checkpoints" << std::endl;
+	std::cout << std::endl;
+	std::cout << "  --frames <n>                         run n emulated frames, default 60" << std::endl;
+	std::cout << "  --cycles <n>                         run n CPU cycles instead, whole frames while they fit then the rest" << std::endl;
+	std::cout << std::endl;
+	std::cout << "  --registers                          print the final CPU registers" << std::endl;
+	std::cout << "  --dump <start>-<end>                 print a memory range (hex) without side effects, -- for registers, repeatable" << std::endl;
+	std::cout << "  --frame <file>                       write the final frame (.png, .rgba or .y4m)" << std::endl;
+	std::cout << "  --capture <file> [--every <n>]       write every nth frame (.png, .rgba or .y4m), default every frame" << std::endl;
+	std::cout << "  --save-state <file>                  save the final machine state" << std::endl;
+}
+
+static RANGE ParseRange(std::string text)
+{
+	size_t dash = text.find('-');
+
+	if (dash == std::string::npos)
+		throw std::invalid_argument(text);
+
+	RANGE range;
+
+	range.start = std::stoul(text.substr(0, dash), nullptr, 16);
+	range.end = std::stoul(text.substr(dash + 1), nullptr, 16);
+
+	if (range.end < range.start)
+		throw std::invalid_argument(text);
+
+	return range;
+}
+
+static void ParseMapper(std::string text, Machine::MAP& map)
+{
+	std::vector<std::string> fields;
+	size_t start = 0;
+
+	for (size_t comma = text.find(','); comma != std::string::npos; comma = text.find(',', start))
+	{
+		fields.push_back(text.substr(start, comma - start));
+		start = comma + 1;
+	}
+
+	fields.push_back(text.substr(start));
+
+	if (fields.size() != 5 || (fields[0] != "ram" && fields[0] != "rom"))
+		throw std::invalid_argument(text);
+
+	map.mapper_type = (fields[0] == "ram") ? Mapper::TYPE::RAM : Mapper::TYPE::ROM;
+	map.mapper_start = std::stoul(fields[1], nullptr, 16);
+	map.mapper_window = std::stoul(fields[2], nullptr, 16);
+	map.mapper_register = std::stoul(fields[3], nullptr, 16);
+	map.mapper_length = std::stoul(fields[4], nullptr, 16);
+
+	if (!Mapper::Valid(map.mapper_start, map.mapper_window, map.mapper_register, map.mapper_length))
+	{
+		std::cout << "moon-run : the mapper window must be whole " << std::hex << Bus::PAGE_SIZE << std::dec << " byte pages inside the 24 bit address space, ";
+		std::cout << "its register below ffffff and outside the window, and its length from one to ffff windows" << std::endl;
+		throw std::invalid_argument(text);
+	}
+}
+
+static void Dump(Bus::SharedPtr bus, RANGE range)
+{
+	// 16 bytes a line, each line starting at its address. Peeked so the dump changes nothing, "--"
+	// for registers and addresses nothing answers.
+
+	uint8_t data = 0;
+
+	std::cout << std::hex << std::setfill('0');
+
+	for (uint64_t line = range.start & ~0xfu; line <= range.end; line += 16)
+	{
+		std::cout << std::setw(6) << line << " :";
+
+		for (uint64_t address = line; address < line + 16; address++)
+		{
+			if (address < range.start || address > range.end)
+				std::cout << "   ";
+			else if (bus->Peek((uint32_t)address, data))
+				std::cout << " " << std::setw(2) << unsigned(data);
+			else
+				std::cout << " --";
+		}
+
+		std::cout << std::endl;
+	}
+
+	std::cout << std::dec;
+}
+
+int main(int argc, char* argv[])
+{
+	Machine::MAP map = Machine::DefaultMap();
+
+	std::string rom_path, banks_path, state_path, replay_path, frame_path, capture_path, save_path;
+	std::vector<RANGE> dumps;
+	uint64_t frames = FRAMES;
+	uint64_t cycles = 0;
+	uint64_t seek = 0;
+	uint32_t every = 1;
+	bool registers = false;
+	bool demo = false;
+	bool frames_given = false;
+	bool seek_given = false;
+	int i = 1;
+
+	try
+	{
+		for (; i < argc; i++)
+		{
+			std::string option = argv[i];
+			bool value = (i + 1 < argc);
+
+			if (option == "--registers")
+				registers = true;
+			else if (option == "--demo")
+				demo = true;
+			else if (option == "--ram" && value)
+			{
+				RANGE range = ParseRange(argv[++i]);
+
+				map.ram_start = range.start;
+				map.ram_end = range.end;
+			}
+			else if (option == "--rom" && value)
+			{
+				RANGE range = ParseRange(argv[++i]);
+
+				map.rom_start = range.start;
+				map.rom_end = range.end;
+			}
+			else if (option == "--mapper" && value)
+				ParseMapper(argv[++i], map);
+			else if (option == "--banks" && value)
+				banks_path = argv[++i];
+			else if (option == "--state" && value)
+				state_path = argv[++i];
+			else if (option == "--replay" && value)
+				replay_path = argv[++i];
+			else if (option == "--seek" && value)
+			{
+				seek = std::stoull(argv[++i]);
+				seek_given = true;
+			}
+			else if (option == "--frames" && value)
+			{
+				frames = std::stoull(argv[++i]);
+				frames_given = true;
+			}
+			else if (option == "--cycles" && value)
+				cycles = std::stoull(argv[++i]);
+			else if (option == "--dump" && value)
+				dumps.push_back(ParseRange(argv[++i]));
+			else if (option == "--frame" && value)
+				frame_path = argv[++i];
+			else if (option == "--capture" && value)
+				capture_path = argv[++i];
+			else if (option == "--every" && value)
+				every = std::max<uint32_t>(1, std::stoul(argv[++i]));
+			else if (option == "--save-state" && value)
+				save_path = argv[++i];
+			else if (option[0] != '-' && rom_path.empty())
+				rom_path = option;
+			else
+				throw std::invalid_argument(option);
+		}
+	}
+	catch (const std::exception&)
+	{
+		std::cout << "moon-run : bad argument " << argv[std::min(i, argc - 1)] << std::endl << std::endl;
+		Usage();
+		return FAIL;
+	}
+
+	if (seek_given && replay_path.empty())
+	{
+		std::cout << "moon-run : --seek needs --replay" << std::endl;
+		return FAIL;
+	}
+
+	Headless headless(DISPLAY_WIDTH, DISPLAY_HEIGHT, map);
+	Machine::SharedPtr machine = headless.GetMachine();
+
+	InputLog::SharedPtr log;
+
+	if (!replay_path.empty())
+	{
+		log = std::make_shared<InputLog>();
+
+		if (!log->Load(replay_path))
+		{
+			std::cout << "moon-run : cannot load input log " << replay_path << std::endl;
+			return FAIL;
+		}
+
+		if (!frames_given)
+			frames = log->GetFrameCount();
+	}
+
+	// A saved state, or the one an input log starts from, brings its own memory contents
+
+	State state;
+
+	if (!state_path.empty() || (log && log->GetStartState(state)))
+	{
+		if (!(state_path.empty() ? machine->LoadState(state) : machine->LoadState(state_path)))
+		{
+			std::cout << "moon-run : cannot load state " << (state_path.empty() ? replay_path : state_path) << std::endl;
+			return FAIL;
+		}
+	}
+	else if (rom_path.empty())
+	{
+		Usage();
+		return FAIL;
+	}
+	else
+	{
+		if (!machine->Load(rom_path) || (!banks_path.empty() && !machine->LoadBanks(banks_path)))
+			return FAIL;
+
+		if (demo)
+			machine->Demo();
+
+		machine->PowerOn();
+	}
+
+	// A replay checks every checkpoint of the log it passes
+
+	Replay::SharedPtr replay;
+
+	if (log)
+	{
+		machine->GetInput()->Replay(log);
+		replay = std::make_shared<Replay>(machine, log);
+	}
+
+	if (seek_given)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		if (!replay->Seek(seek))
+		{
+			std::cout << "moon-run : cannot seek to frame " << seek << std::endl;
+			return FAIL;
+		}
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << "frame " << replay->GetFrame() << " reached in " << elapsed << " s" << std::endl;
+
+		if (!frames_given)
+			frames = replay->GetEndFrame() - replay->GetFrame();
+	}
+
+	auto frame = [&]()
+	{
+		headless.Frame();
+
+		if (replay)
+			replay->Frame();
+	};
+
+	Capture::SharedPtr capture;
+
+	if (!capture_path.empty())
+	{
+		capture = std::make_shared<Capture>(DISPLAY_WIDTH, DISPLAY_HEIGHT, Capture::FormatFromPath(capture_path), capture_path, Capture::POLICY::STALL);
+		headless.SetCapture(capture);
+	}
+
+	headless.SetRenderInterval(capture_path.empty() ? 0 : every);
+
+	Throughput throughput(machine);
+
+	// Cycles run as whole frames while they fit, so replayed input is latched and frames are
+	// captured as usual, then the rest part way into the next frame
+
+	if (cycles != 0)
+	{
+		while (machine->GetClock()->PeekFrame() != 0 && machine->GetClock()->PeekFrame() <= cycles)
+		{
+			cycles -= machine->GetClock()->PeekFrame();
+			frame();
+		}
+
+		machine->RunCycles(cycles);
+	}
+	else
+	{
+		for (uint64_t i = 0; i < frames; i++)
+			frame();
+	}
+
+	std::cout << Throughput::Format(throughput.Sample()) << std::endl;
+
+	// Everything asked for is still reported when the replay or a capture went wrong
+
+	int result = OK;
+
+	if (replay)
+	{
+		std::cout << replay->GetChecked() << " checkpoints checked, " << replay->GetMismatches() << " differ" << std::endl;
+
+		if (replay->GetMismatches() != 0)
+			result = FAIL;
+	}
+
+	headless.SetCapture(nullptr);
+
+	if (capture && !capture->Close())
+	{
+		std::cout << "moon-run : cannot write capture " << capture_path << std::endl;
+		result = FAIL;
+	}
+
+	// Saved before anything inspects the machine, the state is the one the run ended in
+
+	if (!save_path.empty() && !machine->SaveState(save_path, true))
+	{
+		std::cout << "moon-run : cannot save state " << save_path << std::endl;
+		return FAIL;
+	}
+
+	if (registers)
+		std::cout << machine->GetCPU()->Registers() << std::endl;
+
+	for (const RANGE& range : dumps)
+		Dump(machine->GetBus(), range);
+
+	if (!frame_path.empty())
+	{
+		capture = std::make_shared<Capture>(DISPLAY_WIDTH, DISPLAY_HEIGHT, Capture::FormatFromPath(frame_path), frame_path, Capture::POLICY::STALL);
+
+		headless.SetCapture(capture);
+		headless.Render();
+		headless.SetCapture(nullptr);
+
+		std::cout << "frame checksum " << std::hex << std::setw(8) << std::setfill('0') << headless.GetChecksum() << std::dec << std::endl;
+
+		if (!capture->Close())
+		{
+			std::cout << "moon-run : cannot write frame " << frame_path << std::endl;
+			result = FAIL;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,19 @@
+// moonrun.h : Include file for the headless command line runner.
+
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "machine.h"
+#include "headless.h"
+#include "capture.h"
+#include "throughput.h"
+#include "inputlog.h"
+#include "replay.h"
+
+const int OK = 0;
+const int FAIL = -1;
@@ -0,0 +1,5 @@
+// olcPixelGameEngine.cpp : The engine's implementation, compiled once here and linked only by the
+// windowed front end.
+
+#define OLC_PGE_APPLICATION
+#include "olcPixelGameEngine.h"
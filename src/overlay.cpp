@@ -0,0 +1,180 @@
+#include "overlay.h"
+
+Overlay::Overlay(olc::PixelGameEngine* system)
+{
+	this->system = system;
+
+	BuildAtlas();
+}
+
+Overlay::~Overlay()
+{
+}
+
+void Overlay::BuildAtlas()
+{
+	// The engine font is only reachable through DrawString, so every glyph is drawn once with the
+	// same black outline offsets the debug text always used and the result is kept as a mask
+
+	olc::Sprite sprite(GLYPH_COUNT * GLYPH_CELL, GLYPH_CELL);
+
+	for (int32_t i = 0; i < sprite.width * sprite.height; i++)
+		sprite.GetData()[i] = olc::BLANK;
+
+	olc::Sprite* target = system->GetDrawTarget();
+
+	system->SetDrawTarget(&sprite);
+
+	for (uint32_t glyph = 0; glyph < GLYPH_COUNT; glyph++)
+	{
+		std::string text(1, char(GLYPH_FIRST + glyph));
+		int32_t x = glyph * GLYPH_CELL;
+
+		system->DrawString(x + 2, 2, text, olc::BLACK, 1);
+		system->DrawString(x + 0, 0, text, olc::BLACK, 1);
+		system->DrawString(x + 2, 0, text, olc::BLACK, 1);
+		system->DrawString(x + 0, 2, text, olc::BLACK, 1);
+		system->DrawString(x + 0, 1, text, olc::BLACK, 1);
+		system->DrawString(x + 2, 1, text, olc::BLACK, 1);
+		system->DrawString(x + 1, 1, text, olc::WHITE, 1);
+	}
+
+	system->SetDrawTarget(target);
+
+	atlas.resize(sprite.width * sprite.height);
+
+	for (int32_t i = 0; i < sprite.width * sprite.height; i++)
+	{
+		olc::Pixel pixel = sprite.GetData()[i];
+
+		if (pixel.a == 0)
+			atlas[i] = MASK::NONE;
+		else if (pixel.r > 0)
+			atlas[i] = MASK::GLYPH;
+		else
+			atlas[i] = MASK::OUTLINE;
+	}
+}
+
+void Overlay::RasteriseRow(ROW& row)
+{
+	// Neighbouring cells overlap by the outline, a glyph pixel always wins over an outline pixel
+
+	uint32_t width = uint32_t(row.text.size()) * GLYPH_ADVANCE + (GLYPH_CELL - GLYPH_ADVANCE);
+	uint32_t atlas_width = GLYPH_COUNT * GLYPH_CELL;
+
+	std::vector<MASK> mask(width * GLYPH_CELL, MASK::NONE);
+
+	for (size_t i = 0; i < row.text.size(); i++)
+	{
+		uint32_t glyph = uint8_t(row.text[i]) - GLYPH_FIRST;
+
+		if (glyph >= GLYPH_COUNT)
+			continue;
+
+		for (uint32_t y = 0; y < GLYPH_CELL; y++)
+		{
+			const MASK* source = &atlas[y * atlas_width + glyph * GLYPH_CELL];
+			MASK* destination = &mask[y * width + i * GLYPH_ADVANCE];
+
+			for (uint32_t x = 0; x < GLYPH_CELL; x++)
+				if (source[x] > destination[x])
+					destination[x] = source[x];
+		}
+	}
+
+	row.outline.clear();
+	row.glyph.clear();
+
+	for (uint32_t y = 0; y < GLYPH_CELL; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			MASK value = mask[y * width + x];
+
+			if (value == MASK::NONE)
+				continue;
+
+			row.outline.push_back((y << 16) | x);
+
+			if (value == MASK::GLYPH)
+				row.glyph.push_back((y << 16) | x);
+		}
+	}
+}
+
+void Overlay::SetText(uint32_t slot, int32_t x, int32_t y, const std::string& text)
+{
+	if (slot >= texts.size())
+		texts.resize(slot + 1);
+
+	TEXT& entry = texts[slot];
+
+	entry.x = x;
+	entry.y = y;
+
+	size_t count = 0;
+	size_t start = 0;
+
+	while (start <= text.size())
+	{
+		size_t end = text.find('\n', start);
+
+		if (end == std::string::npos)
+			end = text.size();
+
+		if (count >= entry.rows.size())
+			entry.rows.emplace_back();
+
+		ROW& row = entry.rows[count++];
+
+		if (row.text.size() != end - start || row.text.compare(0, row.text.size(), text, start, end - start) != 0)
+		{
+			row.text.assign(text, start, end - start);
+			RasteriseRow(row);
+		}
+
+		start = end + 1;
+	}
+
+	entry.rows.resize(count);
+}
+
+void Overlay::Clear()
+{
+	texts.clear();
+}
+
+void Overlay::DrawRow(const ROW& row, int32_t x, int32_t y, olc::Pixel colour, bool outline)
+{
+	olc::Sprite* target = system->GetDrawTarget();
+	olc::Pixel* data = target->GetData();
+
+	const std::vector<int32_t>& offsets = outline ? row.outline : row.glyph;
+
+	for (int32_t offset : offsets)
+	{
+		int32_t px = x + (offset & 0xffff);
+		int32_t py = y + (offset >> 16);
+
+		if (px >= 0 && px < target->width && py >= 0 && py < target->height)
+			data[py * target->width + px] = colour;
+	}
+}
+
+void Overlay::Draw()
+{
+	// Outlines of a whole text go down before its glyphs so a row never covers the one above it
+
+	for (const TEXT& text : texts)
+	{
+		int32_t x = text.x - 1;
+		int32_t y = text.y - 1;
+
+		for (size_t i = 0; i < text.rows.size(); i++)
+			DrawRow(text.rows[i], x, y + int32_t(i * GLYPH_ADVANCE), olc::BLACK, true);
+
+		for (size_t i = 0; i < text.rows.size(); i++)
+			DrawRow(text.rows[i], x, y + int32_t(i * GLYPH_ADVANCE), olc::WHITE, false);
+	}
+}
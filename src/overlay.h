@@ -0,0 +1,55 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "olcPixelGameEngine.h"
+
+// Outlined debug text, each text row is only rasterised again when its string changes and is drawn
+// from cached pixel offsets every frame
+
+class Overlay
+{
+public:
+	typedef std::shared_ptr<Overlay> SharedPtr;
+
+	static const uint32_t GLYPH_FIRST = 32;
+	static const uint32_t GLYPH_COUNT = 96;
+	static const uint32_t GLYPH_ADVANCE = 8;
+	static const uint32_t GLYPH_CELL = 10;
+
+	enum class MASK : uint8_t { NONE = 0, OUTLINE = 1, GLYPH = 2 };
+
+private:
+	typedef struct
+	{
+		std::string text;
+		std::vector<int32_t> outline;
+		std::vector<int32_t> glyph;
+	} ROW;
+
+	typedef struct
+	{
+		int32_t x;
+		int32_t y;
+		std::vector<ROW> rows;
+	} TEXT;
+
+	olc::PixelGameEngine* system;
+
+	std::vector<MASK> atlas;
+	std::vector<TEXT> texts;
+
+	void BuildAtlas();
+	void RasteriseRow(ROW& row);
+	void DrawRow(const ROW& row, int32_t x, int32_t y, olc::Pixel colour, bool outline);
+
+public:
+	Overlay(olc::PixelGameEngine* system);
+	~Overlay();
+
+	void SetText(uint32_t slot, int32_t x, int32_t y, const std::string& text);
+	void Clear();
+	void Draw();
+};
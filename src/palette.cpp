@@ -0,0 +1,160 @@
+#include "palette.h"
+
+Palette::Palette()
+{
+	memset(entries, 0, sizeof(entries));
+
+	background = BACKGROUND;
+	dirty = (1 << PALETTES) - 1;
+
+	Update();
+}
+
+Palette::~Palette()
+{
+}
+
+void Palette::Set(uint32_t palette, uint8_t index, uint16_t colour)
+{
+	palette %= PALETTES;
+
+	if (entries[palette][index] == colour)
+		return;
+
+	entries[palette][index] = colour;
+	dirty |= 1 << palette;
+}
+
+uint16_t Palette::Get(uint32_t palette, uint8_t index)
+{
+	return entries[palette % PALETTES][index];
+}
+
+const uint16_t* Palette::GetEntries(uint32_t palette)
+{
+	return entries[palette % PALETTES];
+}
+
+void Palette::SetBackground(uint32_t colour)
+{
+	if (background == colour)
+		return;
+
+	background = colour;
+	dirty = (1 << PALETTES) - 1;
+}
+
+uint32_t Palette::GetBackground()
+{
+	return background;
+}
+
+uint8_t Palette::Update()
+{
+	// Expand the palettes written since the last call, returns which ones changed
+
+	uint8_t changed = dirty;
+
+	for (uint32_t i = 0; i < PALETTES; i++)
+	{
+		if (dirty & (1 << i))
+			ExpandLut(entries[i], background, luts[i]);
+	}
+
+	dirty = 0;
+
+	return changed;
+}
+
+const uint32_t* Palette::GetLut(uint32_t palette)
+{
+	return luts[palette % PALETTES];
+}
+
+void Palette::SaveState(State& state)
+{
+	state.Begin("PAL ");
+	state.Put32(PALETTES);
+
+	for (uint32_t palette = 0; palette < PALETTES; palette++)
+		for (uint32_t index = 0; index < ENTRIES; index++)
+			state.Put16(entries[palette][index]);
+
+	state.Put32(background);
+	state.End();
+}
+
+bool Palette::LoadState(State& state)
+{
+	if (!state.Find("PAL ") || state.Get32() != PALETTES)
+		return false;
+
+	for (uint32_t palette = 0; palette < PALETTES; palette++)
+		for (uint32_t index = 0; index < ENTRIES; index++)
+			entries[palette][index] = state.Get16();
+
+	background = state.Get32();
+
+	// Every lookup table is expanded again on the next Update
+
+	dirty = (1 << PALETTES) - 1;
+
+	return !state.GetFailed();
+}
+
+void Palette::MapPages(Bus* bus)
+{
+	bus->MapPages(START, END, nullptr, nullptr, this);
+}
+
+bool Palette::ValidWrite(uint32_t address)
+{
+	return ValidRead(address);
+}
+
+bool Palette::ValidRead(uint32_t address)
+{
+	return address >= START && address <= END;
+}
+
+void Palette::Write(uint32_t address, uint8_t data)
+{
+	uint32_t offset = address - START;
+	uint32_t palette = offset / (ENTRIES * 2);
+	uint8_t index = (offset / 2) % ENTRIES;
+	uint16_t colour = entries[palette][index];
+
+	if (offset & 1)
+		Set(palette, index, (colour & 0x00ff) | (data << 8));
+	else
+		Set(palette, index, (colour & 0xff00) | data);
+}
+
+uint8_t Palette::Read(uint32_t address)
+{
+	uint32_t offset = address - START;
+	uint16_t colour = entries[offset / (ENTRIES * 2)][(offset / 2) % ENTRIES];
+
+	return (offset & 1) ? (colour >> 8) : (colour & 0xff);
+}
+
+uint32_t Palette::Expand(uint16_t colour)
+{
+	// Each 4 bit channel is the high nibble of its byte, the luminance its low nibble, opaque
+
+	uint32_t r = ((colour & 0xf000) >> 8) + (colour & 0x000f);
+	uint32_t g = ((colour & 0x0f00) >> 4) + (colour & 0x000f);
+	uint32_t b = (colour & 0x00f0) + (colour & 0x000f);
+
+	return 0xff000000 | (b << 16) | (g << 8) | r;
+}
+
+void Palette::ExpandLut(const uint16_t* entries, uint32_t background, uint32_t* lut)
+{
+	// Index 0 is transparent on every layer, so its slot carries the background colour instead
+
+	lut[0] = background;
+
+	for (uint32_t i = 1; i < ENTRIES; i++)
+		lut[i] = Expand(entries[i]);
+}
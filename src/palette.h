@@ -0,0 +1,61 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#include "bus.h"
+#include "state.h"
+
+// Palette RAM, PALETTES independent palettes of 256 packed 4:4:4:4 colours with their expanded
+// lookup tables, a palette is only expanded again after one of its entries changed. Expanded colours
+// are 32 bit words in olc::Pixel's layout, red in the lowest byte and alpha in the highest.
+
+class Palette : public BusDevice
+{
+public:
+	typedef std::shared_ptr<Palette> SharedPtr;
+
+	static const uint32_t PALETTES = 8;
+	static const uint32_t ENTRIES = 256;
+
+	// Bus address map, palette n starts at START + n * ENTRIES * 2, little endian entries
+
+	static const uint32_t START = 0x101000;
+	static const uint32_t END = 0x101fff;
+
+	static const uint32_t BACKGROUND = 0xff004040;	// olc::VERY_DARK_YELLOW
+
+private:
+	uint16_t entries[PALETTES][ENTRIES];	// packed 4:4:4:4 r, g, b, luminance
+	uint32_t luts[PALETTES][ENTRIES];		// expanded colours, entry 0 holds the background
+	uint32_t background;
+	uint8_t dirty;							// palettes changed since the last Update, one bit each
+
+public:
+	Palette();
+	~Palette();
+
+	void Set(uint32_t palette, uint8_t index, uint16_t colour);
+	uint16_t Get(uint32_t palette, uint8_t index);
+	const uint16_t* GetEntries(uint32_t palette);
+
+	void SetBackground(uint32_t colour);
+	uint32_t GetBackground();
+
+	uint8_t Update();
+	const uint32_t* GetLut(uint32_t palette);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	void MapPages(Bus* bus);
+
+	bool ValidWrite(uint32_t address) override;
+	bool ValidRead(uint32_t address) override;
+	void Write(uint32_t address, uint8_t data) override;
+	uint8_t Read(uint32_t address) override;
+
+	static uint32_t Expand(uint16_t colour);
+	static void ExpandLut(const uint16_t* entries, uint32_t background, uint32_t* lut);
+};
@@ -1,8 +1,7 @@
 #include "ram.h"
 
-Ram::Ram(olc::PixelGameEngine* system, uint32_t startAddress, uint32_t endAddress)
+Ram::Ram(uint32_t startAddress, uint32_t endAddress)
 {
-	this->system = system;
 	this->startAddress = startAddress;
 	this->endAddress = endAddress;
 
@@ -24,6 +23,23 @@ void Ram::Reset()
 		RAM[address] = rand() % 256;
 }
 
+void Ram::SaveState(State& state)
+{
+	state.Begin("RAM ");
+	state.Put32(startAddress);
+	state.Put32(endAddress);
+	state.PutBytes(RAM.get(), (endAddress - startAddress) + 1);
+	state.End();
+}
+
+bool Ram::LoadState(State& state)
+{
+	if (!state.Find("RAM ") || state.Get32() != startAddress || state.Get32() != endAddress)
+		return false;
+
+	return state.GetBytes(RAM.get(), (endAddress - startAddress) + 1);
+}
+
 bool Ram::ValidWrite(uint32_t address)
 {
 	if (address >= startAddress && address <= endAddress)
@@ -8,8 +8,7 @@
 #include <bitSet>
 
 #include "bus.h"
-
-#include "olcPixelGameEngine.h"
+#include "state.h"
 
 class Ram : public BusDevice
 {
@@ -17,7 +16,6 @@ public:
 	typedef std::shared_ptr<Ram> SharedPtr;
 
 private:
-	olc::PixelGameEngine* system;
 	uint32_t startAddress;
 	uint32_t endAddress;
 
@@ -25,11 +23,14 @@ private:
 
 
 public:
-	Ram(olc::PixelGameEngine* system, uint32_t startAddress, uint32_t endAddress);
+	Ram(uint32_t startAddress, uint32_t endAddress);
 	~Ram();
 
 	void Reset();
 
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
 	bool ValidWrite(uint32_t address) override;
 	bool ValidRead(uint32_t address) override;
 	void Write(uint32_t address, uint8_t data) override;
@@ -0,0 +1,112 @@
+#include "renderpool.h"
+
+RenderPool::RenderPool(uint32_t threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	running = true;
+	generation = 0;
+
+	band = nullptr;
+	rows = 0;
+	bands = 0;
+	next_band = 0;
+	active = 0;
+
+	// The calling thread is worker 0, so only threads - 1 helpers are spawned, once
+
+	for (uint32_t worker = 1; worker < threads; worker++)
+		this->threads.emplace_back(&RenderPool::Work, this, worker);
+}
+
+RenderPool::~RenderPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+
+	start.notify_all();
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+uint32_t RenderPool::GetWorkers()
+{
+	return (uint32_t)threads.size() + 1;
+}
+
+void RenderPool::Claim(uint32_t worker)
+{
+	// Bands are claimed dynamically but every row is rendered exactly once by a pure function
+	// of the frame state, so the output never depends on which worker took which band
+
+	for (uint32_t index = next_band++; index < bands; index = next_band++)
+	{
+		uint32_t first = index * BAND_ROWS;
+		uint32_t last = std::min(first + BAND_ROWS, rows);
+
+		(*band)(first, last, worker);
+	}
+}
+
+void RenderPool::Work(uint32_t worker)
+{
+	uint64_t seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			start.wait(lock, [&] { return !running || generation != seen; });
+
+			if (!running)
+				return;
+
+			seen = generation;
+		}
+
+		Claim(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (--active == 0)
+				finished.notify_one();
+		}
+	}
+}
+
+void RenderPool::Run(uint32_t rows, const Band& band)
+{
+	if (threads.empty() || rows <= BAND_ROWS)
+	{
+		band(0, rows, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->band = &band;
+		this->rows = rows;
+		bands = (rows + BAND_ROWS - 1) / BAND_ROWS;
+		next_band = 0;
+		active = (uint32_t)threads.size();
+
+		++generation;
+	}
+
+	start.notify_all();
+
+	Claim(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	finished.wait(lock, [&] { return active == 0; });
+
+	this->band = nullptr;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class RenderPool
+{
+public:
+	typedef std::shared_ptr<RenderPool> SharedPtr;
+
+	// Renders rows [first, last) using the scratch slot belonging to worker
+	typedef std::function<void(uint32_t first, uint32_t last, uint32_t worker)> Band;
+
+	static const uint32_t BAND_ROWS = 16;
+
+private:
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable finished;
+
+	bool running;
+	uint64_t generation;
+
+	const Band* band;
+	uint32_t rows;
+	uint32_t bands;
+	std::atomic<uint32_t> next_band;
+	uint32_t active;
+
+	void Work(uint32_t worker);
+	void Claim(uint32_t worker);
+
+public:
+	RenderPool(uint32_t threads = 0);
+	~RenderPool();
+
+	// Worker slots including the calling thread, which always takes part in Run
+	uint32_t GetWorkers();
+
+	void Run(uint32_t rows, const Band& band);
+};
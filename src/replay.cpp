@@ -0,0 +1,107 @@
+#include "replay.h"
+
+Replay::Replay(Machine::SharedPtr machine, InputLog::SharedPtr log, uint32_t interval)
+{
+	this->machine = machine;
+	this->log = log;
+	this->interval = std::max(1u, interval);
+
+	checked = 0;
+	mismatches = 0;
+}
+
+Replay::~Replay()
+{
+}
+
+void Replay::Frame()
+{
+	// Called after each emulated frame, the checkpoint holds the state the next frame starts from
+
+	uint64_t frame = GetFrame();
+
+	if (frame <= log->GetFirstFrame())
+		return;
+
+	if (log->HasCheckpoint(frame))
+	{
+		if (machine->GetInput()->GetMode() != Input::MODE::REPLAY)
+			return;
+
+		state.Clear();
+		machine->SaveState(state);
+
+		++checked;
+
+		if (!log->MatchCheckpoint(frame, state))
+		{
+			++mismatches;
+			std::cout << "Replay::Frame() : frame " << frame << " differs from its checkpoint" << std::endl;
+		}
+
+		return;
+	}
+
+	if ((frame - log->GetFirstFrame()) % interval != 0)
+		return;
+
+	state.Clear();
+	machine->SaveState(state);
+
+	log->SetCheckpoint(frame, state);
+}
+
+bool Replay::Build()
+{
+	// Replays from the last checkpoint to the end, adding the checkpoints a log recorded without
+	// them is missing
+
+	return Seek(GetEndFrame());
+}
+
+bool Replay::Seek(uint64_t frame)
+{
+	// Leaves the machine replaying the log, about to run frame. Seeking forward within the same
+	// checkpoint interval carries on from the current frame instead of restoring.
+
+	frame = std::min(std::max(frame, log->GetFirstFrame()), GetEndFrame());
+
+	// A log without a start state only seeks forward from where its replay is
+
+	uint64_t checkpoint_frame = 0;
+	bool restored = log->GetCheckpoint(frame, state, checkpoint_frame);
+	bool resume = machine->GetInput()->GetMode() == Input::MODE::REPLAY && GetFrame() >= checkpoint_frame && GetFrame() <= frame;
+
+	if (!resume && !(restored && machine->LoadState(state)))
+		return false;
+
+	machine->GetInput()->Replay(log);
+
+	while (GetFrame() < frame)
+	{
+		machine->RunFrame();
+		Frame();
+	}
+
+	return true;
+}
+
+uint64_t Replay::GetFrame()
+{
+	return machine->GetClock()->GetFrames();
+}
+
+uint64_t Replay::GetEndFrame()
+{
+	return log->GetFirstFrame() + log->GetFrameCount();
+}
+
+uint64_t Replay::GetChecked()
+{
+	return checked;
+}
+
+uint64_t Replay::GetMismatches()
+{
+	return mismatches;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+
+#include "machine.h"
+#include "inputlog.h"
+#include "state.h"
+
+// Seeking within an input log. A checkpoint of the machine state is added to the log every interval
+// frames while it is recorded or replayed, seeking to a frame restores the nearest checkpoint at or
+// before it and replays the logged input from there. A replay passing a checkpoint already in the
+// log checks that it arrived at the same state.
+
+class Replay
+{
+public:
+	typedef std::shared_ptr<Replay> SharedPtr;
+
+	static const uint32_t CHECKPOINT_INTERVAL = 600;	// emulated frames between checkpoints
+
+private:
+	Machine::SharedPtr machine;
+	InputLog::SharedPtr log;
+	uint32_t interval;
+
+	State state;
+	uint64_t checked;
+	uint64_t mismatches;
+
+public:
+	Replay(Machine::SharedPtr machine, InputLog::SharedPtr log, uint32_t interval = CHECKPOINT_INTERVAL);
+	~Replay();
+
+	void Frame();
+	bool Build();
+	bool Seek(uint64_t frame);
+
+	uint64_t GetFrame();
+	uint64_t GetEndFrame();
+	uint64_t GetChecked();
+	uint64_t GetMismatches();
+};
@@ -0,0 +1,294 @@
+#include "rewind.h"
+
+Rewind::Rewind(Machine::SharedPtr machine, uint32_t interval, size_t budget, uint32_t keyframe_interval)
+{
+	this->machine = machine;
+	this->interval = std::max(1u, interval);
+	this->budget = budget;
+	this->keyframe_interval = std::max(1u, keyframe_interval);
+
+	groups = 0;
+
+	Clear();
+}
+
+Rewind::~Rewind()
+{
+}
+
+void Rewind::Clear()
+{
+	entries.clear();
+	used = 0;
+	frame_count = 0;
+	keyframe.clear();
+	layout.clear();
+	keyframe_group = 0;
+	current_group = 0;
+}
+
+void Rewind::Frame()
+{
+	// Called once per emulated frame
+
+	if (frame_count % interval == 0)
+		Push();
+
+	++frame_count;
+}
+
+void Rewind::Push()
+{
+	state.Clear();
+	machine->SaveState(state);
+
+	std::vector<uint8_t>& chunks = state.GetChunks();
+
+	Layout(chunks, scratch_layout);
+
+	Entry entry;
+
+	entry.frame = frame_count;
+	entry.size = chunks.size();
+
+	// A new group once the current one is full, or when a chunk changed size (a layer mode change
+	// adds or removes a bitmap) and the state no longer lines up with the keyframe
+
+	bool same_layout = scratch_layout.size() == layout.size() && std::equal(layout.begin(), layout.end(), scratch_layout.begin(),
+		[](const Chunk& a, const Chunk& b) { return a.offset == b.offset && a.length == b.length; });
+
+	if (entries.empty() || entries.back().group != keyframe_group || entries.back().sequence + 1 >= keyframe_interval || !same_layout)
+	{
+		keyframe = chunks;
+		layout.swap(scratch_layout);
+		keyframe_group = ++groups;
+
+		entry.sequence = 0;
+		State::Compress(chunks.data(), chunks.size(), entry.data);
+	}
+	else
+	{
+		scratch.resize(chunks.size());
+
+		for (uint32_t i = 0; i < layout.size(); i++)
+		{
+			const Chunk& chunk = layout[i];
+
+			if (!State::Xor(&chunks[chunk.offset], &keyframe[chunk.offset], &scratch[chunk.offset], chunk.length))
+				continue;
+
+			Part part;
+
+			part.chunk = i;
+			part.offset = entry.data.size();
+
+			State::Compress(&scratch[chunk.offset], chunk.length, entry.data);
+
+			part.length = entry.data.size() - part.offset;
+			entry.parts.push_back(part);
+		}
+
+		entry.sequence = entries.back().sequence + 1;
+	}
+
+	entry.group = keyframe_group;
+	entry.data.shrink_to_fit();
+
+	used += entry.data.size();
+	entries.push_back(std::move(entry));
+
+	// The machine runs on from here, the next restore is a whole one
+
+	current_group = 0;
+
+	// Deltas are useless without their keyframe, so whole groups go, never the one just added to
+
+	while (used > budget && entries.front().group != keyframe_group)
+	{
+		uint64_t group = entries.front().group;
+
+		while (entries.front().group == group)
+		{
+			used -= entries.front().data.size();
+			entries.pop_front();
+		}
+	}
+}
+
+bool Rewind::Back()
+{
+	// Restores the newest entry and drops it, called repeatedly it walks back through the history.
+	// An entry that does not decode or load ends the history, the machine state is then undefined.
+
+	if (entries.empty())
+		return false;
+
+	bool restored = Restore(entries.back());
+
+	frame_count = entries.back().frame;
+	used -= entries.back().data.size();
+	entries.pop_back();
+
+	if (!restored)
+	{
+		std::cout << "Rewind::Back() : frame " << frame_count << " cannot be restored, history cleared" << std::endl;
+		Clear();
+	}
+
+	return restored;
+}
+
+bool Rewind::Keyframe(uint64_t group)
+{
+	// Walking back leaves the group's keyframe decoded for the rest of its entries
+
+	if (keyframe_group == group)
+		return true;
+
+	keyframe_group = 0;
+	current_group = 0;
+
+	for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+	{
+		if (it->group == group && it->sequence == 0)
+		{
+			keyframe.resize(it->size);
+
+			if (!State::Decompress(it->data.data(), it->data.size(), keyframe.data(), keyframe.size()))
+				return false;
+
+			Layout(keyframe, layout);
+			keyframe_group = group;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Rewind::Restore(const Entry& entry)
+{
+	if (!Keyframe(entry.group))
+		return false;
+
+	// The machine still holds the last restore of this group when nothing ran since, then only the
+	// chunks whose delta differs from that restore's are rebuilt and reloaded. Compression is
+	// deterministic so equal compressed deltas are equal chunks.
+
+	bool patch = current_group == entry.group && machine->GetClock()->GetFrames() == current_frames && machine->GetCPU()->GetClockCount() == current_cycles;
+
+	current_group = 0;
+
+	if (!patch)
+	{
+		current = keyframe;
+		current_parts.assign(layout.size(), std::vector<uint8_t>());
+	}
+
+	std::vector<uint32_t> reload;
+	std::vector<bool> in_entry(layout.size(), false);
+
+	for (const Part& part : entry.parts)
+	{
+		if (part.chunk >= layout.size())
+			return false;
+
+		in_entry[part.chunk] = true;
+
+		std::vector<uint8_t>& packed = current_parts[part.chunk];
+		const uint8_t* data = &entry.data[part.offset];
+
+		if (patch && packed.size() == part.length && std::memcmp(packed.data(), data, part.length) == 0)
+			continue;
+
+		const Chunk& chunk = layout[part.chunk];
+		uint8_t* out = &current[chunk.offset];
+
+		if (!State::Decompress(data, part.length, out, chunk.length))
+			return false;
+
+		State::Xor(out, &keyframe[chunk.offset], out, chunk.length);
+
+		packed.assign(data, data + part.length);
+		reload.push_back(part.chunk);
+	}
+
+	for (uint32_t i = 0; i < layout.size(); i++)
+	{
+		if (in_entry[i] || current_parts[i].empty())
+			continue;
+
+		std::memcpy(&current[layout[i].offset], &keyframe[layout[i].offset], layout[i].length);
+
+		current_parts[i].clear();
+		reload.push_back(i);
+	}
+
+	bool loaded;
+
+	if (!patch)
+	{
+		state.Clear();
+		state.GetChunks().swap(current);
+
+		loaded = machine->LoadState(state);
+
+		state.GetChunks().swap(current);
+	}
+	else
+	{
+		std::sort(reload.begin(), reload.end());
+
+		state.Clear();
+
+		std::vector<uint8_t>& chunks = state.GetChunks();
+
+		for (uint32_t chunk : reload)
+			chunks.insert(chunks.end(), &current[layout[chunk].offset], &current[layout[chunk].offset] + layout[chunk].length);
+
+		loaded = machine->LoadChanged(state);
+	}
+
+	if (!loaded)
+		return false;
+
+	current_group = entry.group;
+	current_frames = machine->GetClock()->GetFrames();
+	current_cycles = machine->GetCPU()->GetClockCount();
+
+	return true;
+}
+
+void Rewind::Layout(const std::vector<uint8_t>& chunks, std::vector<Chunk>& layout)
+{
+	layout.clear();
+
+	size_t offset = 0;
+
+	while (offset + 8 <= chunks.size())
+	{
+		Chunk chunk;
+
+		chunk.offset = offset;
+		chunk.length = std::min<size_t>(8 + (chunks[offset + 4] | (chunks[offset + 5] << 8) | (chunks[offset + 6] << 16) | ((size_t)chunks[offset + 7] << 24)), chunks.size() - offset);
+
+		layout.push_back(chunk);
+		offset += chunk.length;
+	}
+}
+
+size_t Rewind::GetCount()
+{
+	return entries.size();
+}
+
+size_t Rewind::GetUsed()
+{
+	return used;
+}
+
+uint64_t Rewind::GetOldestFrame()
+{
+	return entries.empty() ? frame_count : entries.front().frame;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include "machine.h"
+#include "state.h"
+
+// Rewind history: a machine state every interval emulated frames in a ring of compressed entries.
+// Entries come in groups, a keyframe holding the whole state followed by deltas against it that
+// only carry the chunks differing from the keyframe, each the compressed XOR of the two. Stepping
+// back through a group patches the chunk area of the last restore in place and reloads only the
+// chunks that changed. The oldest groups are dropped to stay within the memory budget.
+
+class Rewind
+{
+public:
+	typedef std::shared_ptr<Rewind> SharedPtr;
+
+	static const uint32_t INTERVAL = 4;						// emulated frames between entries
+	static const uint32_t KEYFRAME_INTERVAL = 64;			// entries per group
+	static const size_t BUDGET = 128 * 1024 * 1024;		// bytes of compressed entries
+
+private:
+	class Chunk {
+	public:
+		size_t offset;		// tag in the chunk area
+		size_t length;		// tag, length and fields
+	};
+
+	class Part {
+	public:
+		uint32_t chunk;		// index in the group's layout
+		size_t offset;		// compressed XOR in the entry data
+		size_t length;
+	};
+
+	class Entry {
+	public:
+		uint64_t frame;		// emulated frame the state was taken on
+		uint64_t group;		// keyframe the entry belongs to
+		uint32_t sequence;	// position in the group, 0 is the keyframe
+		size_t size;		// chunk area size
+		std::vector<uint8_t> data;	// keyframe: the compressed chunk area, delta: the parts
+		std::vector<Part> parts;	// delta: the chunks that differ from the keyframe
+	};
+
+	Machine::SharedPtr machine;
+	uint32_t interval;
+	uint32_t keyframe_interval;
+	size_t budget;
+
+	std::deque<Entry> entries;
+	size_t used;
+	uint64_t frame_count;
+	uint64_t groups;
+
+	State state;
+	std::vector<uint8_t> keyframe;		// chunk area of keyframe_group's keyframe
+	std::vector<Chunk> layout;			// its chunks
+	uint64_t keyframe_group;
+	std::vector<Chunk> scratch_layout;
+	std::vector<uint8_t> scratch;
+
+	std::vector<uint8_t> current;		// chunk area of the last restore
+	std::vector<std::vector<uint8_t>> current_parts;	// its compressed XOR per chunk, empty where it matches the keyframe
+	uint64_t current_group;				// 0 when the machine may no longer match it
+	uint64_t current_frames;			// machine frame and cycle counts just after the restore
+	uint64_t current_cycles;
+
+	bool Keyframe(uint64_t group);
+	bool Restore(const Entry& entry);
+	static void Layout(const std::vector<uint8_t>& chunks, std::vector<Chunk>& layout);
+
+public:
+	Rewind(Machine::SharedPtr machine, uint32_t interval = INTERVAL, size_t budget = BUDGET, uint32_t keyframe_interval = KEYFRAME_INTERVAL);
+	~Rewind();
+
+	void Frame();
+	void Push();
+	bool Back();
+	void Clear();
+
+	size_t GetCount();
+	size_t GetUsed();
+	uint64_t GetOldestFrame();
+};
@@ -1,8 +1,7 @@
 #include "rom.h"
 
-Rom::Rom(olc::PixelGameEngine* system, uint32_t startAddress, uint32_t endAddress)
+Rom::Rom(uint32_t startAddress, uint32_t endAddress)
 {
-	this->system = system;
 	this->startAddress = startAddress;
 	this->endAddress = endAddress;
 
@@ -24,29 +23,45 @@ void Rom::Reset()
 		rom[address] = rand() % 256;
 }
 
-void Rom::Load(std::string filename)
+bool Rom::Load(std::string filename)
 {
+	// An image shorter than the ROM leaves the rest as it was, a longer one is cut off
+
 	std::ifstream romfile;
 
 	romfile.open(filename, std::ios::binary | std::ios::in);
 
-	for (int i = startAddress; (i <= endAddress) && !(romfile.eof()); ++i)
+	if (!romfile.is_open())
 	{
-		uint8_t c;
+		std::cout << "Rom::Load() : cannot open " << filename << std::endl;
+		return false;
+	}
 
-		romfile.read((char*)&c, 1);
+	romfile.read((char*)rom.get(), (endAddress - startAddress) + 1);
+	romfile.close();
 
-		if (!romfile.eof())
-		{
-			std::cout << std::hex << std::setw(6) << std::setfill('0') << i << " : ";
-			std::cout << std::hex << std::setw(2) << std::setfill('0') << unsigned(c) << std::endl;
+	return true;
+}
 
-			rom[i - startAddress] = c;
-		}
-	}
+void Rom::SaveState(State& state)
+{
+	// Saved with the machine so a state resumes without the ROM file
 
-	romfile.close();
+	state.Begin("ROM ");
+	state.Put32(startAddress);
+	state.Put32(endAddress);
+	state.PutBytes(rom.get(), (endAddress - startAddress) + 1);
+	state.End();
+}
+
+bool Rom::LoadState(State& state)
+{
+	if (!state.Find("ROM ") || state.Get32() != startAddress || state.Get32() != endAddress)
+		return false;
+
+	return state.GetBytes(rom.get(), (endAddress - startAddress) + 1);
 }
+
 bool Rom::ValidWrite(uint32_t address)
 {
 	return false;
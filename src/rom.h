@@ -8,8 +8,7 @@
 #include <bitSet>
 
 #include "bus.h"
-
-#include "olcPixelGameEngine.h"
+#include "state.h"
 
 class Rom : public BusDevice
 {
@@ -17,7 +16,6 @@ public:
 	typedef std::shared_ptr<Rom> SharedPtr;
 
 private:
-	olc::PixelGameEngine* system;
 	uint32_t startAddress;
 	uint32_t endAddress;
 
@@ -25,12 +23,15 @@ private:
 
 
 public:
-	Rom(olc::PixelGameEngine* system, uint32_t startAddress, uint32_t endAddress);
+	Rom(uint32_t startAddress, uint32_t endAddress);
 	~Rom();
 
 	void Reset();
 
-	void Load(std::string filename);
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	bool Load(std::string filename);
 
 	bool ValidWrite(uint32_t address) override;
 	bool ValidRead(uint32_t address) override;
@@ -0,0 +1,136 @@
+#include "scheduler.h"
+
+Scheduler::Scheduler(CLOCK clock)
+{
+	this->clock = clock;
+
+	next_event = NEVER;
+}
+
+Scheduler::~Scheduler()
+{
+}
+
+bool Scheduler::Later(const EVENT& a, const EVENT& b)
+{
+	// std heap order is a max-heap, so the comparison is reversed for the earliest event on top
+
+	return a.cycle > b.cycle;
+}
+
+void Scheduler::DropStale()
+{
+	while (!events.empty() && events.front().generation != sources[events.front().id].generation)
+	{
+		std::pop_heap(events.begin(), events.end(), Later);
+		events.pop_back();
+	}
+
+	next_event = events.empty() ? NEVER : events.front().cycle;
+}
+
+uint32_t Scheduler::Register(HANDLER handler)
+{
+	sources.push_back({ handler, 0, NEVER });
+
+	return (uint32_t)sources.size() - 1;
+}
+
+void Scheduler::Schedule(uint32_t id, uint64_t cycle)
+{
+	SOURCE& source = sources[id];
+
+	++source.generation;
+	source.cycle = cycle;
+
+	events.push_back({ cycle, id, source.generation });
+	std::push_heap(events.begin(), events.end(), Later);
+
+	// A source rescheduled far ahead leaves stale entries below the top, rebuild once they dominate
+
+	if (events.size() > 4 * sources.size() + 16)
+	{
+		events.erase(std::remove_if(events.begin(), events.end(), [&](const EVENT& e) { return e.generation != sources[e.id].generation; }), events.end());
+		std::make_heap(events.begin(), events.end(), Later);
+	}
+
+	DropStale();
+}
+
+void Scheduler::Cancel(uint32_t id)
+{
+	SOURCE& source = sources[id];
+
+	++source.generation;
+	source.cycle = NEVER;
+
+	DropStale();
+}
+
+uint64_t Scheduler::GetPending(uint32_t id)
+{
+	return sources[id].cycle;
+}
+
+uint64_t Scheduler::GetNow()
+{
+	return clock();
+}
+
+const uint64_t& Scheduler::NextEvent()
+{
+	// Stays valid while the CPU runs, a bus access that schedules an earlier event moves it
+
+	return next_event;
+}
+
+void Scheduler::Dispatch(uint64_t now)
+{
+	// Every event due by now in cycle order, handlers may schedule again (later than now)
+
+	while (next_event <= now)
+	{
+		EVENT event = events.front();
+
+		std::pop_heap(events.begin(), events.end(), Later);
+		events.pop_back();
+
+		sources[event.id].cycle = NEVER;
+		++sources[event.id].generation;
+
+		DropStale();
+
+		sources[event.id].handler(event.cycle);
+	}
+}
+
+void Scheduler::SaveState(State& state)
+{
+	// The pending cycle of every source in registration order, handlers belong to the devices
+
+	state.Begin("SCHD");
+	state.Put32((uint32_t)sources.size());
+
+	for (const SOURCE& source : sources)
+		state.Put64(source.cycle);
+
+	state.End();
+}
+
+bool Scheduler::LoadState(State& state)
+{
+	if (!state.Find("SCHD") || state.Get32() != sources.size())
+		return false;
+
+	for (uint32_t id = 0; id < sources.size(); id++)
+	{
+		uint64_t cycle = state.Get64();
+
+		if (cycle == NEVER)
+			Cancel(id);
+		else
+			Schedule(id, cycle);
+	}
+
+	return !state.GetFailed();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <memory>
+
+#include "state.h"
+
+// Timed device events on one min-heap keyed by absolute CPU cycle. The CPU runs freely until
+// NextEvent and only the devices with something due are called, so the cost follows the events
+// rather than cycles times devices. Each handler has at most one pending event, scheduling it
+// again replaces the old one (stale heap entries are dropped when they reach the top).
+
+class Scheduler
+{
+public:
+	typedef std::shared_ptr<Scheduler> SharedPtr;
+	typedef std::function<void(uint64_t cycle)> HANDLER;
+	typedef std::function<uint64_t()> CLOCK;
+
+	static const uint64_t NEVER = ~0ull;
+
+private:
+	typedef struct
+	{
+		uint64_t cycle;
+		uint32_t id;
+		uint32_t generation;
+	} EVENT;
+
+	typedef struct
+	{
+		HANDLER handler;
+		uint32_t generation;	// bumped by every Schedule and Cancel, heap entries of older ones are stale
+		uint64_t cycle;			// pending event, NEVER when none
+	} SOURCE;
+
+	CLOCK clock;
+	std::vector<EVENT> events;
+	std::vector<SOURCE> sources;
+	uint64_t next_event;
+
+	static bool Later(const EVENT& a, const EVENT& b);
+	void DropStale();
+
+public:
+	Scheduler(CLOCK clock);
+	~Scheduler();
+
+	uint32_t Register(HANDLER handler);
+
+	void Schedule(uint32_t id, uint64_t cycle);
+	void Cancel(uint32_t id);
+	uint64_t GetPending(uint32_t id);
+
+	uint64_t GetNow();
+	const uint64_t& NextEvent();
+
+	void Dispatch(uint64_t now);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+};
@@ -0,0 +1,502 @@
+#include "state.h"
+
+static const char MAGIC[8] = { 'M', 'O', 'O', 'N', 'S', 'T', 'A', 'T' };
+
+static void PutLittle(uint8_t* out, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		out[i] = (uint8_t)(value >> (i * 8));
+}
+
+static uint64_t GetLittle(const uint8_t* data, int bytes)
+{
+	uint64_t value = 0;
+
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t)data[i] << (i * 8);
+
+	return value;
+}
+
+static void PutLength(std::vector<uint8_t>& out, size_t length)
+{
+	// LZ4 length continuation: 255 bytes while the remainder is 255 or more
+
+	for (; length >= 255; length -= 255)
+		out.push_back(255);
+
+	out.push_back((uint8_t)length);
+}
+
+State::State()
+{
+	Clear();
+}
+
+State::~State()
+{
+}
+
+void State::Clear()
+{
+	chunks.clear();
+	chunk_start = 0;
+	position = 0;
+	chunk_end = 0;
+	failed = false;
+}
+
+size_t State::GetSize()
+{
+	return chunks.size();
+}
+
+bool State::GetFailed()
+{
+	return failed;
+}
+
+std::vector<uint8_t>& State::GetChunks()
+{
+	return chunks;
+}
+
+void State::Begin(const char* tag)
+{
+	chunks.insert(chunks.end(), tag, tag + 4);
+
+	chunk_start = chunks.size();
+
+	Put32(0);
+}
+
+void State::End()
+{
+	PutLittle(&chunks[chunk_start], chunks.size() - chunk_start - 4, 4);
+}
+
+void State::Put8(uint8_t value)
+{
+	chunks.push_back(value);
+}
+
+void State::Put16(uint16_t value)
+{
+	chunks.resize(chunks.size() + 2);
+	PutLittle(&chunks[chunks.size() - 2], value, 2);
+}
+
+void State::Put32(uint32_t value)
+{
+	chunks.resize(chunks.size() + 4);
+	PutLittle(&chunks[chunks.size() - 4], value, 4);
+}
+
+void State::Put64(uint64_t value)
+{
+	chunks.resize(chunks.size() + 8);
+	PutLittle(&chunks[chunks.size() - 8], value, 8);
+}
+
+void State::PutBytes(const void* data, size_t length)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+
+	chunks.insert(chunks.end(), bytes, bytes + length);
+}
+
+bool State::Has(const char* tag)
+{
+	// Looks for an optional chunk without failing the state
+
+	size_t offset = 0;
+
+	while (offset + 8 <= chunks.size())
+	{
+		if (std::memcmp(&chunks[offset], tag, 4) == 0)
+			return true;
+
+		offset += 8 + (size_t)GetLittle(&chunks[offset + 4], 4);
+	}
+
+	return false;
+}
+
+bool State::Find(const char* tag)
+{
+	// Positions the reads at the fields of the chunk, a missing chunk fails the whole state
+
+	size_t offset = 0;
+
+	while (offset + 8 <= chunks.size())
+	{
+		size_t length = (size_t)GetLittle(&chunks[offset + 4], 4);
+
+		if (std::memcmp(&chunks[offset], tag, 4) == 0)
+		{
+			position = offset + 8;
+			chunk_end = std::min(position + length, chunks.size());
+			return true;
+		}
+
+		offset += 8 + length;
+	}
+
+	std::cout << "State::Find(" << std::string(tag, 4) << ") : no chunk" << std::endl;
+
+	position = chunk_end = 0;
+	failed = true;
+
+	return false;
+}
+
+size_t State::GetRemaining()
+{
+	return chunk_end - position;
+}
+
+uint8_t State::Get8()
+{
+	return (uint8_t)GetField(1);
+}
+
+uint16_t State::Get16()
+{
+	return (uint16_t)GetField(2);
+}
+
+uint32_t State::Get32()
+{
+	return (uint32_t)GetField(4);
+}
+
+uint64_t State::Get64()
+{
+	return GetField(8);
+}
+
+uint64_t State::GetField(int bytes)
+{
+	if (position + bytes > chunk_end)
+	{
+		failed = true;
+		return 0;
+	}
+
+	uint64_t value = GetLittle(&chunks[position], bytes);
+
+	position += bytes;
+
+	return value;
+}
+
+bool State::GetBytes(void* data, size_t length)
+{
+	if (position + length > chunk_end)
+	{
+		failed = true;
+		return false;
+	}
+
+	std::memcpy(data, &chunks[position], length);
+	position += length;
+
+	return true;
+}
+
+std::vector<uint8_t> State::Serialise(bool compress)
+{
+	std::vector<uint8_t> out(HEADER_SIZE);
+
+	std::memcpy(&out[0], MAGIC, sizeof(MAGIC));
+	PutLittle(&out[8], VERSION, 4);
+	PutLittle(&out[12], compress ? FLAG_COMPRESSED : 0, 4);
+	PutLittle(&out[16], chunks.size(), 8);
+
+	if (compress)
+		Compress(chunks.data(), chunks.size(), out);
+	else
+		out.insert(out.end(), chunks.begin(), chunks.end());
+
+	PutLittle(&out[24], out.size() - HEADER_SIZE, 8);
+
+	return out;
+}
+
+bool State::Deserialise(const uint8_t* data, size_t length)
+{
+	Clear();
+
+	if (length < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+	{
+		std::cout << "State::Deserialise() : not a machine state" << std::endl;
+		return false;
+	}
+
+	uint32_t version = (uint32_t)GetLittle(&data[8], 4);
+	uint32_t flags = (uint32_t)GetLittle(&data[12], 4);
+	uint64_t size = GetLittle(&data[16], 8);
+	uint64_t stored = GetLittle(&data[24], 8);
+
+	if (version > VERSION)
+	{
+		std::cout << "State::Deserialise() : version " << version << " is newer than " << VERSION << std::endl;
+		return false;
+	}
+
+	if (stored > length - HEADER_SIZE)
+	{
+		std::cout << "State::Deserialise() : truncated" << std::endl;
+		return false;
+	}
+
+	// An LZ4 sequence expands to at most 255 bytes per stored byte, a size beyond that or the hard
+	// limit is corrupt and never allocated
+
+	if (size > MAX_SIZE || size > ((flags & FLAG_COMPRESSED) ? stored * 255 + 16 : stored))
+	{
+		std::cout << "State::Deserialise() : chunk area size " << size << " out of range" << std::endl;
+		return false;
+	}
+
+	if (flags & FLAG_COMPRESSED)
+	{
+		try
+		{
+			chunks.resize((size_t)size);
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "State::Deserialise() : cannot allocate " << size << " bytes" << std::endl;
+			return false;
+		}
+
+		if (!Decompress(&data[HEADER_SIZE], (size_t)stored, chunks.data(), chunks.size()))
+		{
+			std::cout << "State::Deserialise() : corrupt chunk area" << std::endl;
+			chunks.clear();
+			return false;
+		}
+	}
+	else
+	{
+		if (stored != size)
+		{
+			std::cout << "State::Deserialise() : size mismatch" << std::endl;
+			return false;
+		}
+
+		chunks.assign(&data[HEADER_SIZE], &data[HEADER_SIZE] + size);
+	}
+
+	return true;
+}
+
+bool State::Save(std::string filename, bool compress)
+{
+	std::vector<uint8_t> data = Serialise(compress);
+	std::ofstream file;
+
+	file.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+	file.write((const char*)data.data(), data.size());
+	file.close();
+
+	return !file.fail();
+}
+
+bool State::Load(std::string filename)
+{
+	std::ifstream file;
+
+	file.open(filename, std::ios::binary | std::ios::in);
+
+	if (!file.is_open())
+	{
+		std::cout << "State::Load(" << filename << ") : cannot open" << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	return Deserialise(data.data(), data.size());
+}
+
+void State::Compress(const uint8_t* data, size_t length, std::vector<uint8_t>& out)
+{
+	// LZ4 block format: sequences of a token (literal count high nibble, match length - 4 low
+	// nibble), literals, a 16 bit match offset; the last sequence only carries literals. Matches
+	// are found greedily through a hash of the next four bytes.
+
+	static const size_t MIN_MATCH = 4;
+	static const uint32_t HASH_BITS = 16;
+
+	std::vector<uint32_t> table(1 << HASH_BITS, 0);		// position + 1 of the last four bytes with the hash
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (i + MIN_MATCH <= length)
+	{
+		uint32_t sequence = (uint32_t)GetLittle(&data[i], 4);
+		uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+		size_t candidate = table[hash];
+
+		table[hash] = (uint32_t)(i + 1);
+
+		if (candidate == 0 || i - (candidate - 1) > 0xffff || (uint32_t)GetLittle(&data[candidate - 1], 4) != sequence)
+		{
+			// Steps grow through data that keeps missing, as LZ4 does
+
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t match_length = MIN_MATCH;
+
+		while (i + match_length + 8 <= length)
+		{
+			uint64_t a, b;
+
+			std::memcpy(&a, &data[match + match_length], 8);
+			std::memcpy(&b, &data[i + match_length], 8);
+
+			if (a != b)
+				break;
+
+			match_length += 8;
+		}
+
+		while (i + match_length < length && data[match + match_length] == data[i + match_length])
+			++match_length;
+
+		size_t literals = i - anchor;
+
+		out.push_back((uint8_t)((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(match_length - MIN_MATCH, 15)));
+
+		if (literals >= 15)
+			PutLength(out, literals - 15);
+
+		out.insert(out.end(), &data[anchor], &data[i]);
+		out.push_back((uint8_t)(i - match));
+		out.push_back((uint8_t)((i - match) >> 8));
+
+		if (match_length - MIN_MATCH >= 15)
+			PutLength(out, match_length - MIN_MATCH - 15);
+
+		i += match_length;
+		anchor = i;
+	}
+
+	size_t literals = length - anchor;
+
+	out.push_back((uint8_t)(std::min<size_t>(literals, 15) << 4));
+
+	if (literals >= 15)
+		PutLength(out, literals - 15);
+
+	out.insert(out.end(), &data[anchor], &data[length]);
+}
+
+bool State::Decompress(const uint8_t* data, size_t length, uint8_t* out, size_t out_length)
+{
+	// Every length and offset is checked, corrupt input fails rather than writing out of bounds
+
+	size_t in = 0;
+	size_t produced = 0;
+
+	while (in < length)
+	{
+		uint8_t token = data[in++];
+		size_t literals = token >> 4;
+
+		if (literals == 15)
+		{
+			uint8_t extra = 255;
+
+			while (extra == 255 && in < length)
+			{
+				extra = data[in++];
+				literals += extra;
+			}
+		}
+
+		if (literals > length - in || literals > out_length - produced)
+			return false;
+
+		std::memcpy(&out[produced], &data[in], literals);
+		in += literals;
+		produced += literals;
+
+		if (in == length)
+			break;
+
+		if (length - in < 2)
+			return false;
+
+		size_t offset = data[in] | (data[in + 1] << 8);
+		size_t match_length = (token & 0x0f) + 4;
+
+		in += 2;
+
+		if ((token & 0x0f) == 15)
+		{
+			uint8_t extra = 255;
+
+			while (extra == 255 && in < length)
+			{
+				extra = data[in++];
+				match_length += extra;
+			}
+		}
+
+		if (offset == 0 || offset > produced || match_length > out_length - produced)
+			return false;
+
+		// An overlapping match repeats the last offset bytes. Everything from the match source up to
+		// what was copied so far already holds whole periods, so each copy doubles in length.
+
+		if (offset == 1)
+			std::memset(&out[produced], out[produced - 1], match_length);
+		else
+			for (size_t copied = 0; copied < match_length; )
+			{
+				size_t run = std::min(copied + offset, match_length - copied);
+
+				std::memcpy(&out[produced + copied], &out[produced - offset], run);
+				copied += run;
+			}
+
+		produced += match_length;
+	}
+
+	return produced == out_length;
+}
+
+bool State::Xor(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t length)
+{
+	// True when any byte differs
+
+	uint64_t any = 0;
+	size_t i = 0;
+
+	for (; i + 8 <= length; i += 8)
+	{
+		uint64_t x, y;
+
+		std::memcpy(&x, &a[i], 8);
+		std::memcpy(&y, &b[i], 8);
+
+		x ^= y;
+		any |= x;
+
+		std::memcpy(&out[i], &x, 8);
+	}
+
+	for (; i < length; i++)
+	{
+		out[i] = a[i] ^ b[i];
+		any |= out[i];
+	}
+
+	return any != 0;
+}
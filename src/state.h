@@ -0,0 +1,77 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <memory>
+
+// Machine snapshot: a versioned header and a chunk area in which every component writes its own
+// tagged chunk of little endian fields. Readers look chunks up by tag, skip chunks they do not know
+// and ignore fields appended to a chunk by later versions. The chunk area is optionally LZ4 block
+// compressed.
+//
+//   0	"MOONSTAT"
+//   8	32 bit format version
+//   12	32 bit flags
+//   16	64 bit chunk area size
+//   24	64 bit stored size, then the stored chunk area
+
+class State
+{
+public:
+	typedef std::shared_ptr<State> SharedPtr;
+
+	static const uint32_t VERSION = 1;
+	static const uint32_t FLAG_COMPRESSED = 0x00000001;
+	static const uint32_t HEADER_SIZE = 32;
+	static const uint64_t MAX_SIZE = 1ull << 32;		// largest chunk area accepted from a file
+
+private:
+	std::vector<uint8_t> chunks;	// 4 byte tag, 32 bit length, fields
+	size_t chunk_start;				// length field of the chunk being written
+	size_t position;				// read position
+	size_t chunk_end;				// end of the chunk being read
+	bool failed;					// a chunk was missing or a read ran past its end
+
+	uint64_t GetField(int bytes);
+
+public:
+	State();
+	~State();
+
+	void Clear();
+	size_t GetSize();
+	bool GetFailed();
+	std::vector<uint8_t>& GetChunks();		// the raw chunk area, for delta encoding whole states
+
+	void Begin(const char* tag);
+	void End();
+	void Put8(uint8_t value);
+	void Put16(uint16_t value);
+	void Put32(uint32_t value);
+	void Put64(uint64_t value);
+	void PutBytes(const void* data, size_t length);
+
+	bool Has(const char* tag);
+	bool Find(const char* tag);
+	size_t GetRemaining();
+	uint8_t Get8();
+	uint16_t Get16();
+	uint32_t Get32();
+	uint64_t Get64();
+	bool GetBytes(void* data, size_t length);
+
+	std::vector<uint8_t> Serialise(bool compress);
+	bool Deserialise(const uint8_t* data, size_t length);
+
+	bool Save(std::string filename, bool compress);
+	bool Load(std::string filename);
+
+	static void Compress(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+	static bool Decompress(const uint8_t* data, size_t length, uint8_t* out, size_t out_length);
+	static bool Xor(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t length);
+};
@@ -0,0 +1,95 @@
+#include "throughput.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double ProcessSeconds()
+{
+	// CPU time of all threads of the process, std::clock() is wall time on MSVC
+
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+
+	uint64_t kernel_ticks = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	uint64_t user_ticks = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+	return (double)(kernel_ticks + user_ticks) * 100e-9;
+#else
+	timespec now;
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0)
+		return 0.0;
+
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+Throughput::Throughput(Machine::SharedPtr machine)
+{
+	this->machine = machine;
+
+	Reset();
+}
+
+Throughput::~Throughput()
+{
+}
+
+void Throughput::Reset()
+{
+	wall_start = std::chrono::steady_clock::now();
+	cpu_start = ProcessSeconds();
+	cycles_start = machine->GetCPU()->GetClockCount();
+	instructions_start = machine->GetCPU()->GetInstructionCount();
+	idle_start = machine->GetCPU()->GetIdleCount();
+	loop_start = machine->GetCPU()->GetLoopCount();
+	frames_start = machine->GetClock()->GetFrames();
+}
+
+Throughput::REPORT Throughput::Sample()
+{
+	// Since the last Reset, the window keeps running
+
+	REPORT report;
+
+	report.wall_seconds = GetElapsed();
+	report.host_cpu_seconds = ProcessSeconds() - cpu_start;
+	report.cycles = machine->GetCPU()->GetClockCount() - cycles_start;
+	report.instructions = machine->GetCPU()->GetInstructionCount() - instructions_start;
+	report.frames = machine->GetClock()->GetFrames() - frames_start;
+	report.guest_seconds = (double)report.cycles / (double)machine->GetClock()->GetFrequency();
+
+	report.guest_mhz = (report.wall_seconds > 0.0) ? report.cycles / report.wall_seconds / 1e6 : 0.0;
+	report.mips = (report.wall_seconds > 0.0) ? report.instructions / report.wall_seconds / 1e6 : 0.0;
+	report.host_cpu_per_guest_second = (report.guest_seconds > 0.0) ? report.host_cpu_seconds / report.guest_seconds : 0.0;
+	report.idle = (report.cycles > 0) ? (double)(machine->GetCPU()->GetIdleCount() - idle_start) / report.cycles : 0.0;
+	report.loop = (report.cycles > 0) ? (double)(machine->GetCPU()->GetLoopCount() - loop_start) / report.cycles : 0.0;
+
+	return report;
+}
+
+double Throughput::GetElapsed()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+}
+
+std::string Throughput::Format(const REPORT& report)
+{
+	using namespace std;
+
+	ostringstream stringStream;
+
+	stringStream << fixed << setprecision(2);
+	stringStream << "guest " << report.guest_mhz << " MHz  " << report.mips << " MIPS  ";
+	stringStream << "host CPU " << setprecision(3) << report.host_cpu_per_guest_second << " s per guest s  ";
+	stringStream << setprecision(1) << report.idle * 100.0 << "% idle  " << report.loop * 100.0 << "% loop  " << setprecision(3);
+	stringStream << dec << report.frames << " frames in " << report.wall_seconds << " s";
+
+	return stringStream.str();
+}
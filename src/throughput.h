@@ -0,0 +1,54 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+
+#include "machine.h"
+
+// Guest throughput of a Machine over a measurement window: guest clock rate, instructions per
+// second and the host CPU time (all threads of the process) spent per guest second
+
+class Throughput
+{
+public:
+	typedef std::shared_ptr<Throughput> SharedPtr;
+
+	typedef struct
+	{
+		double wall_seconds;
+		double host_cpu_seconds;
+		double guest_seconds;
+		uint64_t cycles;
+		uint64_t instructions;
+		uint64_t frames;
+		double guest_mhz;					// guest cycles per wall second / 10^6
+		double mips;						// guest instructions per wall second / 10^6
+		double host_cpu_per_guest_second;	// 1.0 is real time on one core
+		double idle;						// share of cycles skipped in WAI or STP
+		double loop;						// share of cycles fast-forwarded through idle loops
+	} REPORT;
+
+private:
+	Machine::SharedPtr machine;
+
+	std::chrono::steady_clock::time_point wall_start;
+	double cpu_start;
+	uint64_t cycles_start;
+	uint64_t instructions_start;
+	uint64_t idle_start;
+	uint64_t loop_start;
+	uint64_t frames_start;
+
+public:
+	Throughput(Machine::SharedPtr machine);
+	~Throughput();
+
+	void Reset();
+	REPORT Sample();
+	double GetElapsed();
+
+	static std::string Format(const REPORT& report);
+};
@@ -0,0 +1,204 @@
+#include "timer.h"
+
+Timer::Timer(Bus::SharedPtr bus, Scheduler::SharedPtr scheduler)
+{
+	this->scheduler = scheduler;
+
+	IRQB = bus->AttachLine1Bit("IRQB");
+
+	t1 = { 0xffff, 0xffff, 0, scheduler->Register([this](uint64_t cycle) { TimeOutT1(cycle); }) };
+	t2 = { 0xffff, 0xffff, 0, scheduler->Register([this](uint64_t) { TimeOutT2(); }) };
+
+	acr = 0x00;
+	ifr = 0x00;
+	ier = 0x00;
+}
+
+Timer::~Timer()
+{
+}
+
+void Timer::MapPages(Bus* bus)
+{
+	bus->MapPages(START, END, nullptr, nullptr, this);
+}
+
+void Timer::SaveState(State& state)
+{
+	// Pending time-outs are part of the scheduler state
+
+	state.Begin("TIMR");
+
+	for (const Counter* counter : { &t1, &t2 })
+	{
+		state.Put16(counter->latch);
+		state.Put16(counter->value);
+		state.Put64(counter->loaded);
+	}
+
+	state.Put8(acr);
+	state.Put8(ifr);
+	state.Put8(ier);
+
+	state.End();
+}
+
+bool Timer::LoadState(State& state)
+{
+	if (!state.Find("TIMR"))
+		return false;
+
+	for (Counter* counter : { &t1, &t2 })
+	{
+		counter->latch = state.Get16();
+		counter->value = state.Get16();
+		counter->loaded = state.Get64();
+	}
+
+	acr = state.Get8();
+	ifr = state.Get8();
+	ier = state.Get8();
+
+	return !state.GetFailed();
+}
+
+uint16_t Timer::ReadT1(uint64_t now)
+{
+	// Counts down once per cycle and times out on the step past zero (value + 1 cycles). Free
+	// running, the counter shows $ffff for that cycle and reloads the latch on the next one, so
+	// later time-outs are latch + 2 cycles apart as on the 6522.
+
+	uint64_t elapsed = now - t1.loaded;
+
+	if (elapsed <= t1.value || !(acr & ACR_T1_FREE_RUN))
+		return (uint16_t)(t1.value - elapsed);
+
+	uint64_t phase = (elapsed - t1.value - 1) % ((uint64_t)t1.latch + 2);
+
+	return (phase == 0) ? 0xffff : (uint16_t)(t1.latch - (phase - 1));
+}
+
+uint16_t Timer::ReadT2(uint64_t now)
+{
+	return (uint16_t)(t2.value - (now - t2.loaded));
+}
+
+void Timer::TimeOutT1(uint64_t cycle)
+{
+	ifr |= FLAG_T1;
+
+	if (acr & ACR_T1_FREE_RUN)
+	{
+		t1.loaded = cycle + 1;
+		t1.value = t1.latch;
+
+		scheduler->Schedule(t1.event, cycle + (uint64_t)t1.latch + 2);
+	}
+
+	UpdateIRQ();
+}
+
+void Timer::TimeOutT2()
+{
+	ifr |= FLAG_T2;
+
+	UpdateIRQ();
+}
+
+void Timer::UpdateIRQ()
+{
+	// IRQB is active low, this is the only device driving it
+
+	bool active = (ifr & ier & 0x7f) != 0;
+
+	ifr = active ? (ifr | 0x80) : (ifr & 0x7f);
+
+	*IRQB = active ? 0b0 : 0b1;
+}
+
+bool Timer::ValidWrite(uint32_t address)
+{
+	return ValidRead(address);
+}
+
+bool Timer::ValidRead(uint32_t address)
+{
+	return address >= START && address <= END;
+}
+
+void Timer::Write(uint32_t address, uint8_t data)
+{
+	uint64_t now = scheduler->GetNow();
+
+	switch (address & 0x0f)
+	{
+	case REGISTER_T1C_L:
+	case REGISTER_T1L_L:
+		t1.latch = (t1.latch & 0xff00) | data;
+		break;
+	case REGISTER_T1C_H:
+		t1.latch = (t1.latch & 0x00ff) | (data << 8);
+		t1.value = t1.latch;
+		t1.loaded = now;
+		ifr &= ~FLAG_T1;
+		scheduler->Schedule(t1.event, now + (uint64_t)t1.value + 1);
+		break;
+	case REGISTER_T1L_H:
+		t1.latch = (t1.latch & 0x00ff) | (data << 8);
+		ifr &= ~FLAG_T1;
+		break;
+	case REGISTER_T2C_L:
+		t2.latch = (t2.latch & 0xff00) | data;
+		break;
+	case REGISTER_T2C_H:
+		t2.value = (t2.latch & 0x00ff) | (data << 8);
+		t2.loaded = now;
+		ifr &= ~FLAG_T2;
+		scheduler->Schedule(t2.event, now + (uint64_t)t2.value + 1);
+		break;
+	case REGISTER_ACR:
+		acr = data;
+		break;
+	case REGISTER_IFR:
+		ifr &= ~(data & 0x7f);
+		break;
+	case REGISTER_IER:
+		ier = (data & 0x80) ? (ier | (data & 0x7f)) : (ier & ~(data & 0x7f));
+		break;
+	}
+
+	UpdateIRQ();
+}
+
+uint8_t Timer::Read(uint32_t address)
+{
+	uint64_t now = scheduler->GetNow();
+
+	switch (address & 0x0f)
+	{
+	case REGISTER_T1C_L:
+		ifr &= ~FLAG_T1;
+		UpdateIRQ();
+		return ReadT1(now) & 0xff;
+	case REGISTER_T1C_H:
+		return ReadT1(now) >> 8;
+	case REGISTER_T1L_L:
+		return t1.latch & 0xff;
+	case REGISTER_T1L_H:
+		return t1.latch >> 8;
+	case REGISTER_T2C_L:
+		ifr &= ~FLAG_T2;
+		UpdateIRQ();
+		return ReadT2(now) & 0xff;
+	case REGISTER_T2C_H:
+		return ReadT2(now) >> 8;
+	case REGISTER_ACR:
+		return acr;
+	case REGISTER_IFR:
+		return ifr;
+	case REGISTER_IER:
+		return ier | 0x80;
+	}
+
+	return 0x00;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "bus.h"
+#include "scheduler.h"
+
+// 6522 VIA style timers: T1 one-shot or free running from its latch, T2 one-shot, with the VIA
+// interrupt flag and enable registers driving IRQB. Counters are not ticked, their value is worked
+// out from the cycle they were loaded on and time-outs are scheduler events.
+
+class Timer : public BusDevice
+{
+public:
+	typedef std::shared_ptr<Timer> SharedPtr;
+
+	static const uint32_t START = 0x102000;		// 16 registers, mirrored across the page
+	static const uint32_t END = 0x102fff;
+
+	static const uint32_t REGISTER_T1C_L = 0x4;		// read: counter low, clears the T1 flag / write: latch low
+	static const uint32_t REGISTER_T1C_H = 0x5;		// write: latch high, loads and starts T1
+	static const uint32_t REGISTER_T1L_L = 0x6;
+	static const uint32_t REGISTER_T1L_H = 0x7;		// write clears the T1 flag
+	static const uint32_t REGISTER_T2C_L = 0x8;		// read: counter low, clears the T2 flag / write: latch low
+	static const uint32_t REGISTER_T2C_H = 0x9;		// write: loads and starts T2
+	static const uint32_t REGISTER_ACR = 0xb;		// bit 6: T1 free running
+	static const uint32_t REGISTER_IFR = 0xd;		// bit 7: any enabled flag, writing 1s clears flags
+	static const uint32_t REGISTER_IER = 0xe;		// bit 7 set: enable the written 1s, clear: disable them
+
+	static const uint8_t FLAG_T1 = 0x40;
+	static const uint8_t FLAG_T2 = 0x20;
+	static const uint8_t ACR_T1_FREE_RUN = 0x40;
+
+private:
+	class Counter {
+	public:
+		uint16_t latch;
+		uint16_t value;		// loaded value
+		uint64_t loaded;	// cycle the value was loaded on
+		uint32_t event;		// scheduler id of the time-out
+	};
+
+	Scheduler::SharedPtr scheduler;
+
+	Bus::Line1Bit IRQB;
+
+	Counter t1;
+	Counter t2;
+	uint8_t acr;
+	uint8_t ifr;
+	uint8_t ier;
+
+	uint16_t ReadT1(uint64_t now);
+	uint16_t ReadT2(uint64_t now);
+	void TimeOutT1(uint64_t cycle);
+	void TimeOutT2();
+	void UpdateIRQ();
+
+public:
+	Timer(Bus::SharedPtr bus, Scheduler::SharedPtr scheduler);
+	~Timer();
+
+	void MapPages(Bus* bus);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	bool ValidWrite(uint32_t address) override;
+	bool ValidRead(uint32_t address) override;
+	void Write(uint32_t address, uint8_t data) override;
+	uint8_t Read(uint32_t address) override;
+};
@@ -0,0 +1,1334 @@
+#include "video.h"
+
+static void WriteHalf(uint32_t& field, uint32_t byte, uint8_t data, bool sign)
+{
+	uint16_t value = field & 0xffff;
+
+	value = byte ? ((value & 0x00ff) | (data << 8)) : ((value & 0xff00) | data);
+
+	field = sign ? (uint32_t)(int32_t)(int16_t)value : value;
+}
+
+static void WriteLayerRegister(Video::Layer& layer, uint32_t offset, uint8_t data)
+{
+	uint32_t shift = (offset & 0x03) * 8;
+	uint32_t mask = ~(0xff << shift);
+
+	switch (offset & 0x1c)
+	{
+	case Video::REGISTER_MODE:
+		if ((offset & 0x1f) == Video::REGISTER_PALETTE)
+			layer.palette = data % Palette::PALETTES;
+		break;
+	case Video::REGISTER_PIXEL_X_START:
+		layer.pixel_x_start = (layer.pixel_x_start & mask) | (data << shift);
+		break;
+	case Video::REGISTER_PIXEL_Y_START:
+		layer.pixel_y_start = (layer.pixel_y_start & mask) | (data << shift);
+		break;
+	case Video::REGISTER_PIXEL_X_SCALE:
+		layer.pixel_x_scale = (layer.pixel_x_scale & mask) | (data << shift);
+		break;
+	case Video::REGISTER_PIXEL_Y_SCALE:
+		layer.pixel_y_scale = (layer.pixel_y_scale & mask) | (data << shift);
+		break;
+	case Video::REGISTER_PIXEL_X_SHEAR:
+		layer.pixel_x_shear = (layer.pixel_x_shear & mask) | (data << shift);
+		break;
+	case Video::REGISTER_PIXEL_Y_SHEAR:
+		layer.pixel_y_shear = (layer.pixel_y_shear & mask) | (data << shift);
+		break;
+	}
+}
+
+Video::Video(uint32_t display_width, uint32_t display_height)
+{
+	this->bus = nullptr;
+	this->display_width = display_width;
+	this->display_height = display_height;
+
+	tile_maps = std::make_unique<uint16_t[]>(LAYERS * TILE_MAP_SIZE + Compositor::ROW_PADDING);
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		layers[i].pixel_x_start = 0;
+		layers[i].pixel_y_start = 0;
+		layers[i].pixel_x_scale = 0x10000;
+		layers[i].pixel_x_shear = 0;
+		layers[i].pixel_y_shear = 0;
+		layers[i].pixel_y_scale = 0x10000;
+		layers[i].edge = EDGE::WRAP;
+		layers[i].palette = 0;
+		layers[i].buffer = nullptr;
+		layers[i].tile_map = &tile_maps[i * TILE_MAP_SIZE];
+
+		SetMode(i, MODE::BITMAP);
+	}
+
+	tile_patterns = std::make_unique<uint8_t[]>(TILE_PATTERN_SIZE);
+	tile_cache_8 = std::make_unique<uint8_t[]>(TILES_8 * 8 * 8 + Compositor::ROW_PADDING);
+	tile_cache_16 = std::make_unique<uint8_t[]>(TILES_16 * 16 * 16 + Compositor::ROW_PADDING);
+	tile_empty_8.set();
+	tile_empty_16.set();
+	tiles_dirty = false;
+
+	sprite_buffer = std::make_unique<uint8_t[]>(SPRITE_BUFFER_SIZE);
+	SetSpriteCount(SPRITES);
+
+	palette = std::make_shared<Palette>();
+
+	screen_buffer_enabled = 0b1111;
+
+	raster_table = 0x000000;
+	raster_enabled = false;
+	rasters.reserve(display_height + 1);
+	line_raster.resize(display_height);
+
+	AddScratch();
+
+	line_dirty.resize(display_height);
+	dirty_lines.reserve(display_height);
+	rendered_frame = nullptr;
+
+	Invalidate();
+}
+
+Video::~Video()
+{
+}
+
+void Video::AddScratch()
+{
+	Scratch worker;
+
+	worker.row = std::make_unique<uint32_t[]>(display_width);
+	worker.indices = std::make_unique<uint8_t[]>(Compositor::IndicesSize(display_width));
+	worker.coverage = std::make_unique<uint64_t[]>(Compositor::CoverageSize(display_width));
+	worker.layer_rows = std::make_unique<uint8_t[]>(LAYERS * (LAYER_WIDTH + Compositor::ROW_PADDING));
+	worker.line_sprites.reserve(MAX_SPRITES);
+	worker.sprite_covered = std::make_unique<uint8_t[]>(display_width);
+
+	scratch.push_back(std::move(worker));
+}
+
+Video::Layer& Video::GetLayer(uint32_t layer)
+{
+	return layers[layer % LAYERS];
+}
+
+void Video::SetMode(uint32_t layer, MODE mode)
+{
+	// Only bitmap layers carry the 1 MB buffer, tile layers live in the map and pattern memory
+
+	layer %= LAYERS;
+
+	layers[layer].mode = mode;
+
+	if (mode == MODE::BITMAP)
+	{
+		if (!layer_buffers[layer])
+		{
+			layer_buffers[layer] = std::make_unique<uint8_t[]>(LAYER_SIZE + Compositor::ROW_PADDING);
+			layer_spans[layer] = std::make_unique<uint64_t[]>(LAYER_HEIGHT);
+		}
+	}
+	else
+	{
+		layer_buffers[layer].reset();
+		layer_spans[layer].reset();
+	}
+
+	layers[layer].buffer = layer_buffers[layer].get();
+}
+
+void Video::SetTransform(uint32_t layer, float scale_x, float scale_y, float angle, float origin_x, float origin_y, float centre_x, float centre_y)
+{
+	// Rotate by angle (radians) and zoom around the screen point centre, which shows the layer point origin
+
+	Layer& target = layers[layer % LAYERS];
+
+	float a = cosf(angle) / scale_x;
+	float b = -sinf(angle) / scale_x;
+	float c = sinf(angle) / scale_y;
+	float d = cosf(angle) / scale_y;
+
+	target.pixel_x_scale = (uint32_t)(int32_t)(a * 65536.0f);
+	target.pixel_x_shear = (uint32_t)(int32_t)(b * 65536.0f);
+	target.pixel_y_shear = (uint32_t)(int32_t)(c * 65536.0f);
+	target.pixel_y_scale = (uint32_t)(int32_t)(d * 65536.0f);
+	target.pixel_x_start = (uint32_t)(int32_t)((origin_x - (a * centre_x) - (b * centre_y)) * 65536.0f);
+	target.pixel_y_start = (uint32_t)(int32_t)((origin_y - (c * centre_x) - (d * centre_y)) * 65536.0f);
+}
+
+void Video::UpdateSpans(uint32_t layer)
+{
+	// Rebuild the opaque span bits of a bitmap layer after its buffer was written directly
+
+	layer %= LAYERS;
+
+	if (!layer_buffers[layer])
+		return;
+
+	for (uint32_t offset = 0; offset < LAYER_SIZE; offset += Compositor::SPAN_WIDTH)
+		UpdateSpan(layer, offset);
+
+	layer_dirty[layer].set();
+}
+
+void Video::UpdateSpan(uint32_t layer, uint32_t offset)
+{
+	const uint8_t* span = &layer_buffers[layer][offset & ~(Compositor::SPAN_WIDTH - 1)];
+	uint64_t& spans = layer_spans[layer][offset / LAYER_WIDTH];
+	uint64_t bit = 1ull << ((offset % LAYER_WIDTH) / Compositor::SPAN_WIDTH);
+	uint64_t any = 0;
+
+	for (uint32_t i = 0; i < Compositor::SPAN_WIDTH; i += 8)
+	{
+		uint64_t pixels;
+
+		memcpy(&pixels, &span[i], 8);
+		any |= pixels;
+	}
+
+	bool opaque = any != 0;
+
+	spans = opaque ? (spans | bit) : (spans & ~bit);
+}
+
+void Video::SetPalette(uint8_t index, uint16_t colour)
+{
+	palette->Set(0, index, colour);
+}
+
+uint16_t Video::GetPalette(uint8_t index)
+{
+	return palette->Get(0, index);
+}
+
+Palette::SharedPtr Video::GetPaletteRam()
+{
+	return palette;
+}
+
+void Video::SetEnabled(uint8_t enabled)
+{
+	screen_buffer_enabled = enabled & 0b1111;
+}
+
+uint8_t Video::GetEnabled()
+{
+	return screen_buffer_enabled;
+}
+
+void Video::SetBackground(uint32_t colour)
+{
+	palette->SetBackground(colour);
+}
+
+Video::Sprite& Video::GetSprite(uint32_t sprite)
+{
+	return sprites[sprite % sprites.size()];
+}
+
+uint32_t Video::GetSpriteCount()
+{
+	return (uint32_t)sprites.size();
+}
+
+void Video::SetSpriteCount(uint32_t count)
+{
+	Sprite sprite = { 0, 0, 0, 0, 0, 0, 0, 0, false };
+
+	sprites.resize(std::min(std::max(1u, count), MAX_SPRITES), sprite);
+}
+
+uint8_t* Video::GetSpriteBuffer()
+{
+	return sprite_buffer.get();
+}
+
+void Video::SetTileMap(uint32_t layer, uint32_t tile_x, uint32_t tile_y, uint16_t entry)
+{
+	uint16_t& map_entry = layers[layer % LAYERS].tile_map[((tile_y % TILE_MAP_HEIGHT) * TILE_MAP_WIDTH) + (tile_x % TILE_MAP_WIDTH)];
+
+	if (map_entry == entry)
+		return;
+
+	map_entry = entry;
+
+	MarkTileRow(layer % LAYERS, tile_y % TILE_MAP_HEIGHT);
+}
+
+void Video::MarkTileRow(uint32_t layer, uint32_t tile_y)
+{
+	// Source lines are kept in layer space, an 8x8 plane appears twice in LAYER_HEIGHT
+
+	if (layers[layer].mode == MODE::BITMAP)
+		return;
+
+	uint32_t tile_size = (layers[layer].mode == MODE::TILE_16) ? 16 : 8;
+
+	for (uint32_t line = tile_y * tile_size; line < LAYER_HEIGHT; line += TILE_MAP_HEIGHT * tile_size)
+		for (uint32_t i = 0; i < tile_size; i++)
+			layer_dirty[layer].set(line + i);
+}
+
+void Video::SetTilePattern(uint32_t offset, uint8_t data)
+{
+	offset %= TILE_PATTERN_SIZE;
+
+	if (tile_patterns[offset] == data)
+		return;
+
+	tile_patterns[offset] = data;
+
+	// The same byte belongs to one 8x8 and one 16x16 pattern
+
+	tile_dirty_8.set(offset / 32);
+	tile_dirty_16.set(offset / 128);
+	tiles_dirty = true;
+}
+
+Compositor::ISA Video::GetISA()
+{
+	return compositor.GetISA();
+}
+
+void Video::SetISA(Compositor::ISA isa)
+{
+	compositor.SetISA(isa);
+}
+
+void Video::SetRenderPool(RenderPool::SharedPtr render_pool)
+{
+	this->render_pool = render_pool;
+
+	if (render_pool)
+		while (scratch.size() < render_pool->GetWorkers())
+			AddScratch();
+}
+
+void Video::MapPages(Bus* bus)
+{
+	// Route the video ranges straight to this device instead of the bus device scan
+
+	this->bus = bus;
+
+	bus->MapPages(REGISTERS_START, SPRITES_END, nullptr, nullptr, this);
+	bus->MapPages(TILE_MAPS_START, TILE_MAPS_END, nullptr, nullptr, this);
+	bus->MapPages(TILE_PATTERNS_START, TILE_PATTERNS_END, nullptr, nullptr, this);
+	bus->MapPages(BITMAPS_START, SPRITE_BUFFER_END, nullptr, nullptr, this);
+
+	palette->MapPages(bus);
+}
+
+void Video::SaveState(State& state)
+{
+	// Registers and video memory, the caches and dirty tracking are rebuilt on load
+
+	state.Begin("VID ");
+
+	state.Put32(LAYERS);
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		const Layer& layer = layers[i];
+
+		state.Put8((uint8_t)layer.mode);
+		state.Put8((uint8_t)layer.edge);
+		state.Put8(layer.palette);
+		state.Put32(layer.pixel_x_start);
+		state.Put32(layer.pixel_y_start);
+		state.Put32(layer.pixel_x_scale);
+		state.Put32(layer.pixel_x_shear);
+		state.Put32(layer.pixel_y_shear);
+		state.Put32(layer.pixel_y_scale);
+
+		if (layer.mode == MODE::BITMAP)
+			state.PutBytes(layer.buffer, LAYER_SIZE);
+	}
+
+	for (uint32_t i = 0; i < LAYERS * TILE_MAP_SIZE; i++)
+		state.Put16(tile_maps[i]);
+
+	state.PutBytes(tile_patterns.get(), TILE_PATTERN_SIZE);
+
+	state.Put32((uint32_t)sprites.size());
+
+	for (const Sprite& sprite : sprites)
+	{
+		state.Put32(sprite.pixel_x);
+		state.Put32(sprite.pixel_y);
+		state.Put32(sprite.buffer_x);
+		state.Put32(sprite.buffer_y);
+		state.Put32(sprite.buffer_width);
+		state.Put32(sprite.buffer_height);
+		state.Put8(sprite.palette);
+		state.Put8(sprite.priority);
+		state.Put8(sprite.enabled);
+	}
+
+	state.PutBytes(sprite_buffer.get(), SPRITE_BUFFER_SIZE);
+
+	state.Put8(screen_buffer_enabled);
+	state.Put32(raster_table);
+	state.Put8(raster_enabled);
+
+	state.End();
+}
+
+bool Video::LoadState(State& state)
+{
+	if (!state.Find("VID ") || state.Get32() != LAYERS)
+		return false;
+
+	// Every enum, palette, priority and count is checked against its limit before it is used, the
+	// renderer indexes tables with them
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		uint8_t mode = state.Get8();
+		uint8_t edge = state.Get8();
+		uint8_t palette_index = state.Get8();
+
+		if (mode > (uint8_t)MODE::TILE_16 || edge > (uint8_t)EDGE::CLAMP || palette_index >= Palette::PALETTES)
+			return false;
+
+		SetMode(i, (MODE)mode);
+
+		Layer& layer = layers[i];
+
+		layer.edge = (EDGE)edge;
+		layer.palette = palette_index;
+		layer.pixel_x_start = state.Get32();
+		layer.pixel_y_start = state.Get32();
+		layer.pixel_x_scale = state.Get32();
+		layer.pixel_x_shear = state.Get32();
+		layer.pixel_y_shear = state.Get32();
+		layer.pixel_y_scale = state.Get32();
+
+		if (layer.mode == MODE::BITMAP)
+		{
+			state.GetBytes(layer.buffer, LAYER_SIZE);
+			UpdateSpans(i);
+		}
+
+		layer_dirty[i].set();
+	}
+
+	for (uint32_t i = 0; i < LAYERS * TILE_MAP_SIZE; i++)
+		tile_maps[i] = state.Get16();
+
+	state.GetBytes(tile_patterns.get(), TILE_PATTERN_SIZE);
+
+	tile_dirty_8.set();
+	tile_dirty_16.set();
+	tiles_dirty = true;
+
+	uint32_t sprite_count = state.Get32();
+
+	if (sprite_count == 0 || sprite_count > MAX_SPRITES)
+		return false;
+
+	SetSpriteCount(sprite_count);
+
+	for (Sprite& sprite : sprites)
+	{
+		sprite.pixel_x = state.Get32();
+		sprite.pixel_y = state.Get32();
+		sprite.buffer_x = state.Get32();
+		sprite.buffer_y = state.Get32();
+		sprite.buffer_width = state.Get32();
+		sprite.buffer_height = state.Get32();
+		sprite.palette = state.Get8();
+		sprite.priority = state.Get8();
+		sprite.enabled = state.Get8() != 0;
+
+		if (sprite.palette >= Palette::PALETTES || sprite.priority > LAYERS)
+			return false;
+	}
+
+	state.GetBytes(sprite_buffer.get(), SPRITE_BUFFER_SIZE);
+	sprite_buffer_dirty.set();
+
+	screen_buffer_enabled = state.Get8();
+	raster_table = state.Get32();
+	raster_enabled = state.Get8() != 0;
+
+	Invalidate();
+
+	return !state.GetFailed();
+}
+
+bool Video::ValidWrite(uint32_t address)
+{
+	return ValidRead(address);
+}
+
+bool Video::ValidRead(uint32_t address)
+{
+	if (address >= REGISTERS_START && address <= PALETTE_END)
+		return true;
+
+	if (address >= TILE_MAPS_START && address <= TILE_MAPS_END)
+		return true;
+
+	if (address >= TILE_PATTERNS_START && address <= TILE_PATTERNS_END)
+		return true;
+
+	if (address >= SPRITES_START && address <= SPRITES_END)
+		return true;
+
+	if (address >= BITMAPS_START && address <= SPRITE_BUFFER_END)
+		return true;
+
+	return false;
+}
+
+void Video::Write(uint32_t address, uint8_t data)
+{
+	if (address >= SPRITE_BUFFER_START && address <= SPRITE_BUFFER_END)
+	{
+		uint32_t offset = address - SPRITE_BUFFER_START;
+
+		if (sprite_buffer[offset] != data)
+		{
+			sprite_buffer[offset] = data;
+			sprite_buffer_dirty.set(offset / SPRITE_BUFFER_WIDTH);
+		}
+	}
+	else if (address >= BITMAPS_START && address <= BITMAPS_END)
+	{
+		uint32_t layer = (address - BITMAPS_START) / LAYER_SIZE;
+
+		uint32_t offset = (address - BITMAPS_START) % LAYER_SIZE;
+
+		if (layers[layer].buffer != nullptr && layers[layer].buffer[offset] != data)
+		{
+			layers[layer].buffer[offset] = data;
+			layer_dirty[layer].set(offset / LAYER_WIDTH);
+
+			if (data != 0x00)
+				layer_spans[layer][offset / LAYER_WIDTH] |= 1ull << ((offset % LAYER_WIDTH) / Compositor::SPAN_WIDTH);
+			else
+				UpdateSpan(layer, offset);
+		}
+	}
+	else if (address >= TILE_PATTERNS_START && address <= TILE_PATTERNS_END)
+	{
+		SetTilePattern(address - TILE_PATTERNS_START, data);
+	}
+	else if (address >= TILE_MAPS_START && address <= TILE_MAPS_END)
+	{
+		uint32_t offset = address - TILE_MAPS_START;
+		uint32_t entry = (offset >> 1) % TILE_MAP_SIZE;
+		uint16_t value = tile_maps[offset >> 1];
+
+		if (offset & 1)
+			value = (value & 0x00ff) | (data << 8);
+		else
+			value = (value & 0xff00) | data;
+
+		SetTileMap((offset >> 1) / TILE_MAP_SIZE, entry % TILE_MAP_WIDTH, entry / TILE_MAP_WIDTH, value);
+	}
+	else if (address >= SPRITES_START && address <= SPRITES_END)
+	{
+		uint32_t offset = address - SPRITES_START;
+
+		if (offset / 0x10 >= sprites.size())
+			return;
+
+		Sprite& sprite = sprites[offset / 0x10];
+
+		switch (offset & 0x0f)
+		{
+		case 0x0: case 0x1: WriteHalf(sprite.pixel_x, offset & 1, data, true); break;
+		case 0x2: case 0x3: WriteHalf(sprite.pixel_y, offset & 1, data, true); break;
+		case 0x4: case 0x5: WriteHalf(sprite.buffer_x, offset & 1, data, false); break;
+		case 0x6: case 0x7: WriteHalf(sprite.buffer_y, offset & 1, data, false); break;
+		case 0x8: case 0x9: WriteHalf(sprite.buffer_width, offset & 1, data, false); break;
+		case 0xa: case 0xb: WriteHalf(sprite.buffer_height, offset & 1, data, false); break;
+		case 0xc: sprite.priority = std::min<uint8_t>(data, LAYERS); break;
+		case 0xd: sprite.enabled = (data & 0x01) != 0; break;
+		case 0xe: sprite.palette = data % Palette::PALETTES; break;
+		}
+	}
+	else if (address >= PALETTE_START && address <= PALETTE_END)
+	{
+		palette->Write(Palette::START + (address - PALETTE_START), data);
+	}
+	else if (address >= REGISTERS_START && address <= REGISTERS_END)
+	{
+		uint32_t offset = address - REGISTERS_START;
+
+		if (offset == REGISTER_ENABLED)
+		{
+			SetEnabled(data);
+		}
+		else if (offset >= REGISTER_RASTER_TABLE && offset < REGISTER_RASTER_TABLE + 3)
+		{
+			uint32_t shift = (offset - REGISTER_RASTER_TABLE) * 8;
+
+			raster_table = (raster_table & ~(0xff << shift)) | (data << shift);
+		}
+		else if (offset == REGISTER_RASTER_ENABLED)
+		{
+			raster_enabled = (data & 0x01) != 0;
+		}
+		else if (offset < LAYERS * 0x20)
+		{
+			if ((offset & 0x1c) == REGISTER_MODE && (offset & 0x1f) != REGISTER_PALETTE)
+			{
+				if ((offset & 0x03) == 0 && data <= (uint8_t)MODE::TILE_16)
+					SetMode(offset / 0x20, (MODE)data);
+				if ((offset & 0x1f) == REGISTER_EDGE && data <= (uint8_t)EDGE::CLAMP)
+					layers[offset / 0x20].edge = (EDGE)data;
+			}
+			else
+			{
+				WriteLayerRegister(layers[offset / 0x20], offset, data);
+			}
+		}
+	}
+}
+
+uint8_t Video::Read(uint32_t address)
+{
+	if (address >= SPRITE_BUFFER_START && address <= SPRITE_BUFFER_END)
+	{
+		return sprite_buffer[address - SPRITE_BUFFER_START];
+	}
+	else if (address >= BITMAPS_START && address <= BITMAPS_END)
+	{
+		uint32_t layer = (address - BITMAPS_START) / LAYER_SIZE;
+
+		if (layers[layer].buffer != nullptr)
+			return layers[layer].buffer[(address - BITMAPS_START) % LAYER_SIZE];
+	}
+	else if (address >= TILE_PATTERNS_START && address <= TILE_PATTERNS_END)
+	{
+		return tile_patterns[address - TILE_PATTERNS_START];
+	}
+	else if (address >= TILE_MAPS_START && address <= TILE_MAPS_END)
+	{
+		uint32_t offset = address - TILE_MAPS_START;
+
+		return (offset & 1) ? (tile_maps[offset >> 1] >> 8) : (tile_maps[offset >> 1] & 0xff);
+	}
+	else if (address >= SPRITES_START && address <= SPRITES_END)
+	{
+		uint32_t offset = address - SPRITES_START;
+		uint32_t shift = (offset & 1) * 8;
+
+		if (offset / 0x10 >= sprites.size())
+			return 0x00;
+
+		Sprite& sprite = sprites[offset / 0x10];
+
+		switch (offset & 0x0e)
+		{
+		case 0x0: return sprite.pixel_x >> shift;
+		case 0x2: return sprite.pixel_y >> shift;
+		case 0x4: return sprite.buffer_x >> shift;
+		case 0x6: return sprite.buffer_y >> shift;
+		case 0x8: return sprite.buffer_width >> shift;
+		case 0xa: return sprite.buffer_height >> shift;
+		case 0xc: return (offset & 1) ? (sprite.enabled ? 0x01 : 0x00) : sprite.priority;
+		case 0xe: return (offset & 1) ? 0x00 : sprite.palette;
+		}
+	}
+	else if (address >= PALETTE_START && address <= PALETTE_END)
+	{
+		return palette->Read(Palette::START + (address - PALETTE_START));
+	}
+	else if (address >= REGISTERS_START && address <= REGISTERS_END)
+	{
+		uint32_t offset = address - REGISTERS_START;
+
+		if (offset == REGISTER_ENABLED)
+			return screen_buffer_enabled;
+
+		if (offset >= REGISTER_RASTER_TABLE && offset < REGISTER_RASTER_TABLE + 3)
+			return raster_table >> ((offset - REGISTER_RASTER_TABLE) * 8);
+
+		if (offset == REGISTER_RASTER_ENABLED)
+			return raster_enabled ? 0x01 : 0x00;
+
+		if (offset < LAYERS * 0x20)
+		{
+			Layer& layer = layers[offset / 0x20];
+			uint32_t shift = (offset & 0x03) * 8;
+
+			switch (offset & 0x1c)
+			{
+			case REGISTER_PIXEL_X_START:
+				return layer.pixel_x_start >> shift;
+			case REGISTER_PIXEL_Y_START:
+				return layer.pixel_y_start >> shift;
+			case REGISTER_PIXEL_X_SCALE:
+				return layer.pixel_x_scale >> shift;
+			case REGISTER_PIXEL_Y_SCALE:
+				return layer.pixel_y_scale >> shift;
+			case REGISTER_PIXEL_X_SHEAR:
+				return layer.pixel_x_shear >> shift;
+			case REGISTER_PIXEL_Y_SHEAR:
+				return layer.pixel_y_shear >> shift;
+			case REGISTER_MODE:
+				if ((offset & 0x1f) == REGISTER_EDGE)
+					return (uint8_t)layer.edge;
+				if ((offset & 0x1f) == REGISTER_PALETTE)
+					return layer.palette;
+				return ((offset & 0x03) == 0) ? (uint8_t)layer.mode : 0x00;
+			}
+		}
+	}
+
+	return 0x00;
+}
+
+void Video::UpdateTiles()
+{
+	// Decode changed 4 bit patterns to one byte per pixel (low nibble is the left pixel),
+	// done before the render workers start so the cache is read only while rendering
+
+	if (!tiles_dirty)
+		return;
+
+	for (uint32_t tile = 0; tile < TILES_8; tile++)
+	{
+		if (!tile_dirty_8[tile])
+			continue;
+
+		const uint8_t* pattern = &tile_patterns[tile * 32];
+		uint8_t* decoded = &tile_cache_8[tile * 64];
+		bool empty = true;
+
+		for (uint32_t i = 0; i < 32; i++)
+		{
+			decoded[i * 2] = pattern[i] & 0x0f;
+			decoded[i * 2 + 1] = pattern[i] >> 4;
+			empty = empty && pattern[i] == 0x00;
+		}
+
+		tile_empty_8[tile] = empty;
+	}
+
+	for (uint32_t tile = 0; tile < TILES_16; tile++)
+	{
+		if (!tile_dirty_16[tile])
+			continue;
+
+		const uint8_t* pattern = &tile_patterns[tile * 128];
+		uint8_t* decoded = &tile_cache_16[tile * 256];
+		bool empty = true;
+
+		for (uint32_t i = 0; i < 128; i++)
+		{
+			decoded[i * 2] = pattern[i] & 0x0f;
+			decoded[i * 2 + 1] = pattern[i] >> 4;
+			empty = empty && pattern[i] == 0x00;
+		}
+
+		tile_empty_16[tile] = empty;
+	}
+
+	tile_dirty_8.reset();
+	tile_dirty_16.reset();
+	tiles_dirty = false;
+}
+
+void Video::Invalidate()
+{
+	frame_dirty = true;
+}
+
+void Video::MarkSprite(const Sprite& sprite)
+{
+	if (!sprite.enabled)
+		return;
+
+	int32_t first = std::max<int32_t>(0, (int32_t)sprite.pixel_y);
+	int32_t last = std::min<int32_t>((int32_t)display_height, (int32_t)sprite.pixel_y + (int32_t)sprite.buffer_height);
+
+	for (int32_t y = first; y < last; y++)
+		line_dirty[y] = 1;
+}
+
+void Video::MarkDirtyLines(uint8_t changed_palettes)
+{
+	// Layers and sprites are also changed directly by the host, so the state the last frame was
+	// rendered with is compared here rather than trusting bus writes alone
+
+	if (rendered_rasters.empty() || sprites.size() != rendered_sprites.size())
+		frame_dirty = true;
+
+	for (uint32_t i = 0; i < LAYERS && !frame_dirty; i++)
+	{
+		if (tiles_dirty && layers[i].mode != MODE::BITMAP)
+			frame_dirty = true;
+	}
+
+	if (frame_dirty)
+	{
+		std::fill(line_dirty.begin(), line_dirty.end(), 1);
+		return;
+	}
+
+	// Lines whose register state (programmed or raster table) differs from the last frame
+
+	uint32_t compared = 0;
+	uint32_t compared_rendered = 0;
+	bool same = SameRaster(rasters[0], rendered_rasters[0]);
+
+	for (uint32_t y = 0; y < display_height; y++)
+	{
+		if (line_raster[y] != compared || rendered_line_raster[y] != compared_rendered)
+		{
+			compared = line_raster[y];
+			compared_rendered = rendered_line_raster[y];
+			same = SameRaster(rasters[compared], rendered_rasters[compared_rendered]);
+		}
+
+		if (!same)
+			line_dirty[y] = 1;
+	}
+
+	// Lines showing a layer whose palette was reprogrammed, the background is resolved through palette 0
+
+	if (changed_palettes)
+	{
+		for (uint32_t y = 0; y < display_height; y++)
+		{
+			const Raster& raster = rasters[line_raster[y]];
+
+			for (uint32_t i = 0; i < LAYERS; i++)
+			{
+				if (((raster.enabled & (1 << i)) && (changed_palettes & (1 << raster.layers[i].palette))) || (changed_palettes & 0x01))
+					line_dirty[y] = 1;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < sprites.size(); i++)
+	{
+		const Sprite& sprite = sprites[i];
+		const Sprite& rendered = rendered_sprites[i];
+
+		if (sprite.pixel_x != rendered.pixel_x || sprite.pixel_y != rendered.pixel_y ||
+			sprite.buffer_x != rendered.buffer_x || sprite.buffer_y != rendered.buffer_y ||
+			sprite.buffer_width != rendered.buffer_width || sprite.buffer_height != rendered.buffer_height ||
+			sprite.palette != rendered.palette || sprite.priority != rendered.priority || sprite.enabled != rendered.enabled)
+		{
+			MarkSprite(rendered);
+			MarkSprite(sprite);
+		}
+		else if (changed_palettes & (1 << sprite.palette))
+		{
+			MarkSprite(sprite);
+		}
+		else if (sprite_buffer_dirty.any() && sprite.enabled)
+		{
+			for (uint32_t line = 0; line < sprite.buffer_height; line++)
+			{
+				int32_t y = (int32_t)sprite.pixel_y + (int32_t)line;
+
+				if (y >= 0 && y < (int32_t)display_height && sprite_buffer_dirty[(sprite.buffer_y + line) & (SPRITE_BUFFER_HEIGHT - 1)])
+					line_dirty[y] = 1;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		if (layer_dirty[i].none())
+			continue;
+
+		for (uint32_t y = 0; y < display_height; y++)
+		{
+			// A rotated or clamped line reads more than one source line
+
+			const Layer& layer = rasters[line_raster[y]].layers[i];
+			uint32_t line = ((layer.pixel_y_start + (y * layer.pixel_y_scale)) & LAYER_MASK) >> 16;
+
+			if ((rasters[line_raster[y]].enabled & (1 << i)) && (Affine(layer) || layer_dirty[i][line]))
+				line_dirty[y] = 1;
+		}
+	}
+}
+
+void Video::BuildRasters()
+{
+	// Walk the raster table once per frame, lines that end up with the same register state share
+	// one Raster so runs of identical lines are set up alike
+
+	rasters.clear();
+	rasters.emplace_back();
+
+	Raster& programmed = rasters.back();
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+		programmed.layers[i] = layers[i];
+
+	programmed.enabled = screen_buffer_enabled;
+	programmed.palettes.clear();
+	programmed.palette_luts.clear();
+	programmed.own_palettes = 0;
+
+	std::fill(line_raster.begin(), line_raster.end(), 0);
+
+	if (!raster_enabled || bus == nullptr)
+		return;
+
+	uint32_t address = raster_table;
+	uint32_t entries = 0;
+	uint32_t wait = 0;
+	bool done = false;
+	uint32_t y = 0;
+
+	for (; y < display_height && !done; y++)
+	{
+		if (wait == 0)
+		{
+			Raster raster = rasters.back();
+
+			while (!done && wait == 0)
+			{
+				// The table is peeked so reading it never touches a register device, an entry that
+				// is not all in memory ends it
+
+				uint8_t entry[RASTER_ENTRY_SIZE];
+				bool readable = true;
+
+				for (uint32_t i = 0; i < RASTER_ENTRY_SIZE && readable; i++)
+					readable = bus->Peek((address + i) & 0xffffff, entry[i]);
+
+				uint8_t lines = entry[0];
+				uint16_t offset = entry[1] | (entry[2] << 8);
+				uint16_t value = entry[3] | (entry[4] << 8);
+
+				address = (address + RASTER_ENTRY_SIZE) & 0xffffff;
+
+				if (!readable || offset == RASTER_END || ++entries > MAX_RASTER_ENTRIES)
+				{
+					done = true;
+					break;
+				}
+
+				WriteRaster(raster, offset, value & 0xff);
+				WriteRaster(raster, offset + 1, value >> 8);
+
+				wait = lines;
+			}
+
+			if (!SameRaster(raster, rasters.back()))
+				rasters.push_back(raster);
+		}
+
+		line_raster[y] = (uint32_t)rasters.size() - 1;
+
+		if (wait > 0)
+			--wait;
+	}
+
+	// The last state holds for the rest of the frame once the table ends
+
+	std::fill(line_raster.begin() + y, line_raster.end(), (uint32_t)rasters.size() - 1);
+
+	// Only the palettes a table actually changed get a lut of their own
+
+	for (uint32_t i = 1; i < rasters.size(); i++)
+	{
+		Raster& raster = rasters[i];
+
+		if (raster.palettes.empty())
+			continue;
+
+		raster.palette_luts.resize(Palette::PALETTES * Palette::ENTRIES);
+
+		for (uint32_t j = 0; j < Palette::PALETTES; j++)
+		{
+			const uint16_t* colours = &raster.palettes[j * Palette::ENTRIES];
+
+			const Raster& previous = rasters[i - 1];
+
+			if (memcmp(colours, palette->GetEntries(j), Palette::ENTRIES * sizeof(uint16_t)) == 0)
+				continue;
+
+			raster.own_palettes |= 1 << j;
+
+			// Tables usually touch a few entries per line, so the previous line's lut is often still valid
+
+			if ((previous.own_palettes & (1 << j)) && memcmp(colours, &previous.palettes[j * Palette::ENTRIES], Palette::ENTRIES * sizeof(uint16_t)) == 0)
+				memcpy(&raster.palette_luts[j * Palette::ENTRIES], &previous.palette_luts[j * Palette::ENTRIES], Palette::ENTRIES * sizeof(uint32_t));
+			else
+				Palette::ExpandLut(colours, palette->GetBackground(), &raster.palette_luts[j * Palette::ENTRIES]);
+		}
+	}
+}
+
+void Video::WriteRaster(Raster& raster, uint32_t offset, uint8_t data)
+{
+	// Layer registers, layer enable and palette RAM, modes are not reloadable per line
+
+	uint32_t entry = Palette::PALETTES * Palette::ENTRIES * 2;
+
+	if (offset == REGISTER_ENABLED)
+	{
+		raster.enabled = data & 0b1111;
+	}
+	else if (offset < LAYERS * 0x20)
+	{
+		if ((offset & 0x1c) != REGISTER_MODE || (offset & 0x1f) == REGISTER_PALETTE)
+			WriteLayerRegister(raster.layers[offset / 0x20], offset, data);
+	}
+	else if (offset >= PALETTE_START - REGISTERS_START && offset <= PALETTE_END - REGISTERS_START)
+	{
+		entry = offset - (PALETTE_START - REGISTERS_START);
+	}
+	else if (offset >= Palette::START - REGISTERS_START && offset <= Palette::END - REGISTERS_START)
+	{
+		entry = offset - (Palette::START - REGISTERS_START);
+	}
+
+	if (entry >= Palette::PALETTES * Palette::ENTRIES * 2)
+		return;
+
+	if (raster.palettes.empty())
+	{
+		raster.palettes.resize(Palette::PALETTES * Palette::ENTRIES);
+
+		for (uint32_t i = 0; i < Palette::PALETTES; i++)
+			memcpy(&raster.palettes[i * Palette::ENTRIES], palette->GetEntries(i), Palette::ENTRIES * sizeof(uint16_t));
+	}
+
+	uint16_t& colour = raster.palettes[entry >> 1];
+
+	if (entry & 1)
+		colour = (colour & 0x00ff) | (data << 8);
+	else
+		colour = (colour & 0xff00) | data;
+}
+
+bool Video::SameRaster(const Raster& a, const Raster& b)
+{
+	if (a.enabled != b.enabled)
+		return false;
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		const Layer& layer_a = a.layers[i];
+		const Layer& layer_b = b.layers[i];
+
+		if (layer_a.mode != layer_b.mode || layer_a.buffer != layer_b.buffer ||
+			layer_a.pixel_x_start != layer_b.pixel_x_start || layer_a.pixel_y_start != layer_b.pixel_y_start ||
+			layer_a.pixel_x_scale != layer_b.pixel_x_scale || layer_a.pixel_y_scale != layer_b.pixel_y_scale ||
+			layer_a.pixel_x_shear != layer_b.pixel_x_shear || layer_a.pixel_y_shear != layer_b.pixel_y_shear ||
+			layer_a.edge != layer_b.edge || layer_a.palette != layer_b.palette)
+			return false;
+	}
+
+	// Programmed palette changes are tracked by the palette RAM itself
+
+	return a.palettes == b.palettes;
+}
+
+const uint32_t* Video::RasterLut(const Raster& raster, uint8_t palette)
+{
+	if (raster.own_palettes & (1 << palette))
+		return &raster.palette_luts[palette * Palette::ENTRIES];
+
+	return this->palette->GetLut(palette);
+}
+
+bool Video::Render(uint32_t* frame)
+{
+	// Renders into display_width * display_height olc::Pixel values, returns false when the
+	// frame already holds this image
+
+	if (frame != rendered_frame)
+		frame_dirty = true;
+
+	uint8_t changed_palettes = palette->Update();
+
+	BuildRasters();
+	MarkDirtyLines(changed_palettes);
+
+	UpdateTiles();
+
+	dirty_lines.clear();
+
+	for (uint32_t y = 0; y < display_height; y++)
+	{
+		if (line_dirty[y])
+			dirty_lines.push_back(y);
+	}
+
+	if (render_pool)
+		render_pool->Run((uint32_t)dirty_lines.size(), [&](uint32_t first, uint32_t last, uint32_t worker) { RenderRows(first, last, frame, scratch[worker]); });
+	else
+		RenderRows(0, (uint32_t)dirty_lines.size(), frame, scratch[0]);
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+		layer_dirty[i].reset();
+
+	std::swap(rendered_rasters, rasters);
+	rendered_line_raster = line_raster;
+	rendered_sprites = sprites;
+	rendered_frame = frame;
+
+	sprite_buffer_dirty.reset();
+	std::fill(line_dirty.begin(), line_dirty.end(), 0);
+	frame_dirty = false;
+
+	return !dirty_lines.empty();
+}
+
+void Video::RenderRows(uint32_t first, uint32_t last, uint32_t* frame, Scratch& scratch)
+{
+	// first and last index the dirty line list
+
+	for (uint32_t i = first; i < last; i++)
+	{
+		uint32_t y = dirty_lines[i];
+
+		RenderRow(y, scratch);
+
+		memcpy(&frame[y * display_width], scratch.row.get(), display_width * sizeof(uint32_t));
+	}
+}
+
+bool Video::Affine(const Layer& layer)
+{
+	// Lines of a layer without y shear read a single source row, the x shear only moves its start
+
+	return layer.pixel_y_shear != 0 || layer.edge == EDGE::CLAMP;
+}
+
+uint64_t Video::ExpandTileRow(const Layer& layer, uint32_t pixel_x, uint32_t pixel_y, uint8_t* row)
+{
+	// Build the LAYER_WIDTH source row from the map so the compositor treats tile and bitmap
+	// layers alike. 8x8 maps are 512 pixels wide and are repeated to fill the row. Only the
+	// tiles the scanline actually samples are expanded, returns the spans holding visible tiles.
+
+	uint32_t tile_shift = (layer.mode == MODE::TILE_16) ? 4 : 3;
+	uint32_t tile_size = 1 << tile_shift;
+	uint32_t plane_size = TILE_MAP_WIDTH << tile_shift;
+	uint32_t tile_count = (layer.mode == MODE::TILE_16) ? TILES_16 : TILES_8;
+	const uint8_t* cache = (layer.mode == MODE::TILE_16) ? tile_cache_16.get() : tile_cache_8.get();
+
+	uint32_t line = (pixel_y >> 16) & (plane_size - 1);
+	uint32_t fine_y = line & (tile_size - 1);
+	const uint16_t* map_row = &layer.tile_map[(line >> tile_shift) * TILE_MAP_WIDTH];
+
+	uint64_t spans = 0;
+	uint64_t span = (((uint64_t)(pixel_x & 0xffff) + (uint64_t)(display_width - 1) * layer.pixel_x_scale) >> 16) + 1;
+	uint32_t first_tile = 0;
+	uint32_t tiles = TILE_MAP_WIDTH;
+
+	if (span < plane_size)
+	{
+		first_tile = ((pixel_x >> 16) & (plane_size - 1)) >> tile_shift;
+		tiles = std::min<uint32_t>(TILE_MAP_WIDTH, (uint32_t)((span + tile_size - 1) >> tile_shift) + 1);
+	}
+
+	for (uint32_t i = 0; i < tiles; i++)
+	{
+		uint32_t tile_x = (first_tile + i) & (TILE_MAP_WIDTH - 1);
+		uint16_t entry = map_row[tile_x];
+		uint32_t tile = (entry & TILE_INDEX) % tile_count;
+		uint8_t palette = (entry & TILE_PALETTE) >> 8;
+		uint32_t source_y = (entry & TILE_FLIP_Y) ? (tile_size - 1 - fine_y) : fine_y;
+		const uint8_t* source = &cache[((tile << tile_shift) + source_y) << tile_shift];
+		uint8_t* destination = &row[tile_x << tile_shift];
+
+		if (!(layer.mode == MODE::TILE_16 ? tile_empty_16[tile] : tile_empty_8[tile]))
+		{
+			spans |= 1ull << ((tile_x << tile_shift) / Compositor::SPAN_WIDTH);
+
+			if (plane_size < LAYER_WIDTH)
+				spans |= 1ull << (((tile_x << tile_shift) + plane_size) / Compositor::SPAN_WIDTH);
+		}
+
+		if (entry & TILE_FLIP_X)
+		{
+			for (uint32_t x = 0; x < tile_size; x++)
+			{
+				uint8_t pixel = source[tile_size - 1 - x];
+				destination[x] = pixel ? (palette | pixel) : 0x00;
+			}
+		}
+		else
+		{
+			for (uint32_t x = 0; x < tile_size; x++)
+			{
+				uint8_t pixel = source[x];
+				destination[x] = pixel ? (palette | pixel) : 0x00;
+			}
+		}
+
+		if (plane_size < LAYER_WIDTH)
+			memcpy(&destination[plane_size], destination, tile_size);
+	}
+
+	return spans;
+}
+
+void Video::RenderRow(uint32_t y, Scratch& scratch)
+{
+	// Per row set up: without y shear the source row of a layer is fixed for the whole scanline,
+	// leaving only the x step and a 10 bit wrap to the compositor. Rotated or clamped layers are
+	// handed over as a transform and sampled by the compositor for the blocks still uncovered.
+
+	const Raster& raster = rasters[line_raster[y]];
+	const Layer* layers = raster.layers;
+	const uint32_t* lut = RasterLut(raster, 0);
+
+	Compositor::LAYERROW layer_rows[LAYERS];
+	Compositor::LAYERAFFINE layer_affine[LAYERS];
+	int layer_slots[LAYERS];
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < LAYERS; i++)
+	{
+		layer_slots[i] = -1;
+
+		if (raster.enabled & (1 << i))
+		{
+			const Layer& layer = layers[i];
+			uint32_t line_x = layer.pixel_x_start + (y * layer.pixel_x_shear);
+			uint32_t line_y = layer.pixel_y_start + (y * layer.pixel_y_scale);
+
+			layer_rows[count].lut = RasterLut(raster, layer.palette);
+
+			if (Affine(layer))
+			{
+				Compositor::LAYERAFFINE& affine = layer_affine[i];
+
+				affine.source = layer.buffer;
+				affine.tile_map = nullptr;
+				affine.tile_shift = 0;
+				affine.tile_count = 0;
+
+				if (layer.mode != MODE::BITMAP)
+				{
+					affine.source = (layer.mode == MODE::TILE_16) ? tile_cache_16.get() : tile_cache_8.get();
+					affine.tile_map = layer.tile_map;
+					affine.tile_shift = (layer.mode == MODE::TILE_16) ? 4 : 3;
+					affine.tile_count = (layer.mode == MODE::TILE_16) ? TILES_16 : TILES_8;
+				}
+
+				affine.pixel_x = line_x;
+				affine.pixel_y = line_y;
+				affine.pixel_x_step = layer.pixel_x_scale;
+				affine.pixel_y_step = layer.pixel_y_shear;
+				affine.clamp = layer.edge == EDGE::CLAMP;
+
+				layer_rows[count].source = nullptr;
+				layer_rows[count].pixel_x = 0;
+				layer_rows[count].pixel_x_scale = 0x10000;
+				layer_rows[count].spans = ~0ull;
+				layer_rows[count].affine = &affine;
+			}
+			else
+			{
+				uint32_t pixel_y = line_y & LAYER_MASK;
+
+				if (layer.mode == MODE::BITMAP)
+				{
+					layer_rows[count].source = &layer.buffer[(pixel_y >> 16) * LAYER_WIDTH];
+					layer_rows[count].spans = layer_spans[i][pixel_y >> 16];
+				}
+				else
+				{
+					uint8_t* expanded = &scratch.layer_rows[i * (LAYER_WIDTH + Compositor::ROW_PADDING)];
+
+					layer_rows[count].source = expanded;
+					layer_rows[count].spans = ExpandTileRow(layer, line_x & LAYER_MASK, pixel_y, expanded);
+				}
+
+				layer_rows[count].pixel_x = line_x & LAYER_MASK;
+				layer_rows[count].pixel_x_scale = layer.pixel_x_scale;
+				layer_rows[count].affine = nullptr;
+			}
+
+			layer_slots[i] = count;
+			++count;
+		}
+	}
+
+	compositor.Compose(layer_rows, count, lut, scratch.row.get(), display_width, scratch.indices.get(), scratch.coverage.get());
+
+	RenderSprites(y, raster, layer_rows, layer_slots, scratch);
+}
+
+void Video::RenderSprites(uint32_t y, const Raster& raster, const Compositor::LAYERROW* layer_rows, const int* layer_slots, Scratch& scratch)
+{
+	// Sprite evaluation for this scanline: collect the sprites crossing it, front most first
+	// (lowest priority value, then lowest sprite number), so the cost follows the visible sprites
+
+	std::vector<uint32_t>& line_sprites = scratch.line_sprites;
+
+	line_sprites.clear();
+
+	for (uint32_t i = 0; i < sprites.size(); i++)
+	{
+		const Sprite& sprite = sprites[i];
+		int32_t line = (int32_t)y - (int32_t)sprite.pixel_y;
+
+		if (sprite.enabled && line >= 0 && line < (int32_t)sprite.buffer_height)
+			line_sprites.push_back(i);
+	}
+
+	if (line_sprites.empty())
+		return;
+
+	std::stable_sort(line_sprites.begin(), line_sprites.end(), [&](uint32_t a, uint32_t b) { return sprites[a].priority < sprites[b].priority; });
+
+	uint32_t* row = scratch.row.get();
+	uint8_t* covered = scratch.sprite_covered.get();
+
+	memset(covered, 0, display_width);
+
+	for (uint32_t index : line_sprites)
+	{
+		const Sprite& sprite = sprites[index];
+		const uint32_t* lut = RasterLut(raster, sprite.palette);
+		uint32_t source_y = (sprite.buffer_y + ((int32_t)y - (int32_t)sprite.pixel_y)) & (SPRITE_BUFFER_HEIGHT - 1);
+		const uint8_t* source = &sprite_buffer[source_y * SPRITE_BUFFER_WIDTH];
+
+		int32_t first = std::max<int32_t>(0, (int32_t)sprite.pixel_x);
+		int32_t last = std::min<int32_t>((int32_t)display_width, (int32_t)sprite.pixel_x + (int32_t)sprite.buffer_width);
+
+		for (int32_t x = first; x < last; x++)
+		{
+			uint8_t pixel_lookup = source[(sprite.buffer_x + (x - (int32_t)sprite.pixel_x)) & (SPRITE_BUFFER_WIDTH - 1)];
+
+			if (pixel_lookup == 0x00 || covered[x])
+				continue;
+
+			// Hidden where any enabled layer in front of the sprite is opaque
+
+			bool hidden = false;
+
+			for (uint32_t i = 0; i < sprite.priority && !hidden; i++)
+			{
+				if (layer_slots[i] < 0)
+					continue;
+
+				const Compositor::LAYERROW& layer_row = layer_rows[layer_slots[i]];
+				uint32_t pixel_x = layer_row.pixel_x + (x * layer_row.pixel_x_scale);
+
+				if (layer_row.affine != nullptr)
+					hidden = Compositor::SamplePixel(*layer_row.affine, x) != 0x00;
+				else
+					hidden = layer_row.source[(pixel_x >> 16) & (LAYER_WIDTH - 1)] != 0x00;
+			}
+
+			if (hidden)
+				continue;
+
+			row[x] = lut[pixel_lookup];
+			covered[x] = 1;
+		}
+	}
+}
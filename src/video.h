@@ -0,0 +1,259 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <bitSet>
+
+#include "bus.h"
+#include "palette.h"
+#include "state.h"
+#include "compositor.h"
+#include "renderpool.h"
+
+class Video : public BusDevice
+{
+public:
+	typedef std::shared_ptr<Video> SharedPtr;
+
+	static const uint32_t LAYERS = 4;
+	static const uint32_t LAYER_WIDTH = 1024;
+	static const uint32_t LAYER_HEIGHT = 1024;
+	static const uint32_t LAYER_SIZE = LAYER_WIDTH * LAYER_HEIGHT;
+	static const uint32_t LAYER_MASK = 0x3ffffff;	// 10.16 fixed point, wraps at 1024 pixels
+
+	static const uint32_t TILE_MAP_WIDTH = 64;
+	static const uint32_t TILE_MAP_HEIGHT = 64;
+	static const uint32_t TILE_MAP_SIZE = TILE_MAP_WIDTH * TILE_MAP_HEIGHT;	// entries per layer
+	static const uint32_t TILE_PATTERN_SIZE = 0x10000;						// bytes of 4 bit per pixel patterns
+	static const uint32_t TILES_8 = TILE_PATTERN_SIZE / 32;					// 8x8 tiles in pattern memory
+	static const uint32_t TILES_16 = TILE_PATTERN_SIZE / 128;				// 16x16 tiles in pattern memory
+
+	static const uint16_t TILE_INDEX = 0x03ff;		// tile map entry: pattern number
+	static const uint16_t TILE_FLIP_X = 0x0400;		// tile map entry: mirror horizontally
+	static const uint16_t TILE_FLIP_Y = 0x0800;		// tile map entry: mirror vertically
+	static const uint16_t TILE_PALETTE = 0xf000;	// tile map entry: upper nibble of the colour index
+
+	// Bus address map
+
+	static const uint32_t REGISTERS_START = 0x100000;		// 0x20 bytes per layer, then global registers
+	static const uint32_t REGISTERS_END = 0x1000ff;
+	static const uint32_t PALETTE_START = 0x100100;			// palette 0 of the palette RAM, 256 little endian entries
+	static const uint32_t PALETTE_END = 0x1002ff;
+	static const uint32_t TILE_MAPS_START = 0x110000;		// TILE_MAP_SIZE little endian entries per layer
+	static const uint32_t TILE_MAPS_END = 0x117fff;
+	static const uint32_t TILE_PATTERNS_START = 0x120000;
+	static const uint32_t TILE_PATTERNS_END = 0x12ffff;
+	static const uint32_t SPRITES_START = 0x100400;			// 0x10 bytes of attributes per sprite
+	static const uint32_t SPRITES_END = 0x1007ff;
+	static const uint32_t BITMAPS_START = 0x200000;			// LAYER_SIZE bytes per bitmap layer
+	static const uint32_t BITMAPS_END = 0x5fffff;
+	static const uint32_t SPRITE_BUFFER_START = 0x600000;	// SPRITE_BUFFER_SIZE bytes of sprite pixels
+	static const uint32_t SPRITE_BUFFER_END = 0x6fffff;
+
+	static const uint32_t REGISTER_PIXEL_X_START = 0x00;
+	static const uint32_t REGISTER_PIXEL_Y_START = 0x04;
+	static const uint32_t REGISTER_PIXEL_X_SCALE = 0x08;
+	static const uint32_t REGISTER_PIXEL_Y_SCALE = 0x0c;
+	static const uint32_t REGISTER_MODE = 0x10;
+	static const uint32_t REGISTER_EDGE = 0x11;
+	static const uint32_t REGISTER_PALETTE = 0x12;
+	static const uint32_t REGISTER_PIXEL_X_SHEAR = 0x14;
+	static const uint32_t REGISTER_PIXEL_Y_SHEAR = 0x18;
+	static const uint32_t REGISTER_ENABLED = 0x80;
+	static const uint32_t REGISTER_RASTER_TABLE = 0x84;		// 24 bit bus address of the raster table
+	static const uint32_t REGISTER_RASTER_ENABLED = 0x88;
+
+	// Raster table entries are RASTER_ENTRY_SIZE bytes: line count, register offset from REGISTERS_START
+	// (16 bit, palette RAM included) and a 16 bit value. The value is written at the start of a
+	// line and the next entry is taken line count lines later, 0 chains it on the same line.
+
+	static const uint32_t RASTER_ENTRY_SIZE = 5;
+	static const uint16_t RASTER_END = 0xffff;			// register offset ending the table
+	static const uint32_t MAX_RASTER_ENTRIES = 4096;	// entries read per frame
+
+	static const uint32_t SPRITE_BUFFER_WIDTH = 1024;
+	static const uint32_t SPRITE_BUFFER_HEIGHT = 1024;
+	static const uint32_t SPRITE_BUFFER_SIZE = SPRITE_BUFFER_WIDTH * SPRITE_BUFFER_HEIGHT;
+	static const uint32_t SPRITES = 32;			// default sprite count
+	static const uint32_t MAX_SPRITES = 64;		// sprites reachable through the bus
+
+	enum class MODE
+	{
+		BITMAP = 0,
+		TILE_8 = 1,
+		TILE_16 = 2,
+	};
+
+	enum class EDGE
+	{
+		WRAP = 0,
+		CLAMP = 1,
+	};
+
+	// Source position of screen pixel (x, y), all 16.16 fixed point:
+	//   source_x = pixel_x_start + x * pixel_x_scale + y * pixel_x_shear
+	//   source_y = pixel_y_start + x * pixel_y_shear + y * pixel_y_scale
+
+	class Layer {
+	public:
+		MODE mode;
+		EDGE edge;
+		uint8_t palette;		// palette RAM palette the layer colours are looked up in
+		uint32_t pixel_x_start;
+		uint32_t pixel_y_start;
+		uint32_t pixel_x_scale;		// A
+		uint32_t pixel_x_shear;		// B
+		uint32_t pixel_y_shear;		// C
+		uint32_t pixel_y_scale;		// D
+		uint8_t* buffer;		// LAYER_SIZE bitmap, only allocated in BITMAP mode, call UpdateSpans after writing it directly
+		uint16_t* tile_map;		// TILE_MAP_SIZE entries
+	};
+
+	class Sprite {
+	public:
+		uint32_t pixel_x;			// screen position, signed
+		uint32_t pixel_y;
+		uint32_t buffer_x;			// source rectangle in the sprite buffer
+		uint32_t buffer_y;
+		uint32_t buffer_width;
+		uint32_t buffer_height;
+		uint8_t palette;			// palette RAM palette
+		uint8_t priority;			// drawn in front of layers >= priority, 0 is in front of all
+		bool enabled;
+	};
+
+private:
+	class Raster {
+	public:
+		Layer layers[LAYERS];
+		uint8_t enabled;
+		std::vector<uint16_t> palettes;			// colours of every palette once the table writes one, empty for the programmed ones
+		std::vector<uint32_t> palette_luts;		// expanded palettes, filled for own_palettes only
+		uint8_t own_palettes;					// palettes that differ from the programmed ones, one bit each
+	};
+
+	class Scratch {
+	public:
+		std::unique_ptr<uint32_t[]> row;			// composited scanline
+		std::unique_ptr<uint8_t[]> indices;			// colour indices of the scanline before the palette lookup
+		std::unique_ptr<uint64_t[]> coverage;		// opaque pixels of the scanline, one bit each
+		std::unique_ptr<uint8_t[]> layer_rows;		// expanded tile layer source rows
+		std::vector<uint32_t> line_sprites;			// sprites on the current scanline, front first
+		std::unique_ptr<uint8_t[]> sprite_covered;	// pixels already taken by a sprite
+	};
+
+	Bus* bus;		// raster tables are read through the bus the video is mapped on
+
+	uint32_t display_width;
+	uint32_t display_height;
+
+	Layer layers[LAYERS];
+	std::unique_ptr<uint8_t[]> layer_buffers[LAYERS];
+	std::unique_ptr<uint64_t[]> layer_spans[LAYERS];	// per bitmap row, bit n set when pixels [16n, 16n + 16) may be opaque
+	std::unique_ptr<uint16_t[]> tile_maps;
+
+	std::unique_ptr<uint8_t[]> tile_patterns;
+	std::unique_ptr<uint8_t[]> tile_cache_8;		// decoded 8x8 patterns, one byte per pixel
+	std::unique_ptr<uint8_t[]> tile_cache_16;		// decoded 16x16 patterns, one byte per pixel
+	std::bitset<TILES_8> tile_dirty_8;
+	std::bitset<TILES_16> tile_dirty_16;
+	std::bitset<TILES_8> tile_empty_8;		// decoded pattern is fully transparent
+	std::bitset<TILES_16> tile_empty_16;
+	bool tiles_dirty;
+
+	std::vector<Sprite> sprites;
+	std::unique_ptr<uint8_t[]> sprite_buffer;
+
+	Palette::SharedPtr palette;
+
+	uint8_t screen_buffer_enabled;
+
+	uint32_t raster_table;
+	bool raster_enabled;
+	std::vector<Raster> rasters;			// distinct register states of the frame, 0 is the programmed one
+	std::vector<uint32_t> line_raster;		// raster index for every output line
+
+	std::vector<Scratch> scratch;		// one per render worker
+
+	// Dirty tracking, only lines whose inputs changed since the last frame are rendered again
+
+	bool frame_dirty;
+	std::bitset<LAYER_HEIGHT> layer_dirty[LAYERS];				// source lines written since the last frame
+	std::bitset<SPRITE_BUFFER_HEIGHT> sprite_buffer_dirty;		// sprite buffer rows written since the last frame
+	std::vector<uint8_t> line_dirty;							// output lines to render
+	std::vector<uint32_t> dirty_lines;
+
+	std::vector<Raster> rendered_rasters;	// state the previous frame was rendered with
+	std::vector<uint32_t> rendered_line_raster;
+	std::vector<Sprite> rendered_sprites;
+	uint32_t* rendered_frame;
+
+	Compositor compositor;
+	RenderPool::SharedPtr render_pool;
+
+	void AddScratch();
+	void UpdateSpan(uint32_t layer, uint32_t offset);
+	static bool Affine(const Layer& layer);
+	uint64_t ExpandTileRow(const Layer& layer, uint32_t pixel_x, uint32_t pixel_y, uint8_t* row);
+	void MarkTileRow(uint32_t layer, uint32_t tile_y);
+	void MarkSprite(const Sprite& sprite);
+	void MarkDirtyLines(uint8_t changed_palettes);
+	void BuildRasters();
+	void WriteRaster(Raster& raster, uint32_t offset, uint8_t data);
+	static bool SameRaster(const Raster& a, const Raster& b);
+	const uint32_t* RasterLut(const Raster& raster, uint8_t palette);
+	void RenderRows(uint32_t first, uint32_t last, uint32_t* frame, Scratch& scratch);
+	void RenderRow(uint32_t y, Scratch& scratch);
+	void RenderSprites(uint32_t y, const Raster& raster, const Compositor::LAYERROW* layer_rows, const int* layer_slots, Scratch& scratch);
+
+public:
+	Video(uint32_t display_width, uint32_t display_height);
+	~Video();
+
+	Layer& GetLayer(uint32_t layer);
+
+	void SetMode(uint32_t layer, MODE mode);
+	void SetTransform(uint32_t layer, float scale_x, float scale_y, float angle, float origin_x, float origin_y, float centre_x, float centre_y);
+	void UpdateSpans(uint32_t layer);
+
+	void SetPalette(uint8_t index, uint16_t colour);		// entry of palette 0
+	uint16_t GetPalette(uint8_t index);
+	Palette::SharedPtr GetPaletteRam();
+
+	void SetEnabled(uint8_t enabled);
+	uint8_t GetEnabled();
+
+	void SetBackground(uint32_t colour);
+
+	Sprite& GetSprite(uint32_t sprite);
+	uint32_t GetSpriteCount();
+	void SetSpriteCount(uint32_t count);
+	uint8_t* GetSpriteBuffer();		// call Invalidate after writing it directly
+
+	void SetTileMap(uint32_t layer, uint32_t tile_x, uint32_t tile_y, uint16_t entry);
+	void SetTilePattern(uint32_t offset, uint8_t data);
+
+	Compositor::ISA GetISA();
+	void SetISA(Compositor::ISA isa);
+
+	void SetRenderPool(RenderPool::SharedPtr render_pool);
+
+	void MapPages(Bus* bus);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
+	bool ValidWrite(uint32_t address) override;
+	bool ValidRead(uint32_t address) override;
+	void Write(uint32_t address, uint8_t data) override;
+	uint8_t Read(uint32_t address) override;
+
+	bool Render(uint32_t* frame);
+	void Invalidate();
+	void UpdateTiles();
+};
@@ -1,9 +1,8 @@
 #include "w65c816s.h"
 
-W65C816S::W65C816S(Bus::SharedPtr bus, olc::PixelGameEngine* system)
+W65C816S::W65C816S(Bus::SharedPtr bus)
 {
 	this->bus = bus;
-	this->system = system;
 
 	running = false;
 
@@ -28,10 +27,10 @@ W65C816S::W65C816S(Bus::SharedPtr bus, olc::PixelGameEngine* system)
 	BE = bus->CreateLine1Bit("BE", 0b0);
 	D0_D7 = bus->CreateLine8Bit("D0_D7", 0b0);
 	E = bus->CreateLine1Bit("E", 0b0);
-	IRQB = bus->CreateLine1Bit("IRQB", 0b0);
+	IRQB = bus->CreateLine1Bit("IRQB", 0b1);
 	MLB = bus->CreateLine1Bit("MLB", 0b0);
 	MX = bus->CreateLine1Bit("MX", 0b0);
-	NMIB = bus->CreateLine1Bit("NMIB", 0b0);
+	NMIB = bus->CreateLine1Bit("NMIB", 0b1);
 	PHI2 = bus->CreateLine1Bit("PHI2", 0b0);
 	RWB = bus->CreateLine1Bit("RWB", 0b0);
 	RDY = bus->CreateLine1Bit("RDY", 0b0);
@@ -43,9 +42,26 @@ W65C816S::W65C816S(Bus::SharedPtr bus, olc::PixelGameEngine* system)
 	reset_low_cycles = 0;
 	reset_low = false;
 
+	stp = false;
 	wai = false;
 
 	clock_count = 0x0000000000000000;
+	instruction_count = 0x0000000000000000;
+	idle_count = 0x0000000000000000;
+	loop_count = 0x0000000000000000;
+
+	loop.head = Loop::NONE;
+	loop.last = 0x000000;
+	loop.start = 0;
+	loop.instructions = 0;
+	loop.x = loop.y = 0x0000;
+	loop.p = 0x00;
+	loop.low[0] = loop.low[1] = loop.high[0] = loop.high[1] = 0;
+	loop.pure = false;
+	loop.cycles = 0;
+	loop.delta[0] = loop.delta[1] = 0;
+
+	trace = false;
 }
 
 W65C816S::~W65C816S()
@@ -134,35 +150,406 @@ void W65C816S::Clock()
 	if (stp == true)
 		return;
 
+	// WAI ends when an interrupt line goes low, execution carries on after it (interrupt entry is
+	// not emulated yet, which matches WAI with the I flag set)
+
 	if (wai == true)
-		return;
+	{
+		if (*IRQB != 0b0 && *NMIB != 0b0)
+			return;
+
+		wai = false;
+	}
 
 	if (instruction_cycles == 0)
 	{
-		std::cout << "Fetched : " << std::hex << std::setw(2) << std::setfill('0') << unsigned(data_in) << " : ";
-
 		IR = data_in;
 
+		++instruction_count;
+
+		if (trace)
+		{
+			std::cout << "Fetched : " << std::hex << std::setw(2) << std::setfill('0') << unsigned(IR) << " : ";
+			std::cout << opcodes[IR].mnemonic << " (" << addressing_modes[(int)opcodes[IR].addressing_mode].description << ")" << std::endl;
+		}
+	}
+	else if (trace)
+	{
+		std::cout << "Executing : " << std::hex << std::setw(2) << std::setfill('0') << unsigned(IR) << " : " << std::dec << unsigned(instruction_cycles) << " : ";
 		std::cout << opcodes[IR].mnemonic << " (" << addressing_modes[(int)opcodes[IR].addressing_mode].description << ")" << std::endl;
+	}
 
-		if (opcodes[IR].function != nullptr)
-			(this->*(opcodes[IR].function))((void*)&opcodes[IR]);
-		else
-			std::cout << "function not defined" << std::endl;
+	if (opcodes[IR].function != nullptr)
+		(this->*(opcodes[IR].function))((void*)&opcodes[IR]);
+	else if (trace)
+		std::cout << "function not defined" << std::endl;
+}
 
-		return;
+void W65C816S::Cycle()
+{
+	// One PHI2 period run on the calling thread, the same phases Run and Bus::Run hand over
+	// through the bus lines: address out while PHI2 is high, data transfer while it is low,
+	// then the CPU clocks on the rising edge.
+
+	*A0_A15 = address_out.db0_15;
+	*D0_D7 = address_out.b16_23;
+
+	uint32_t address = ((uint32_t)address_out.b16_23 << 16) | address_out.db0_15;
+
+	if (*RWB == 0b0)
+	{
+		*D0_D7 = data_out;
+		bus->Write(address, data_out);
 	}
 	else
 	{
-		std::cout << "Executing : " << std::hex << std::setw(2) << std::setfill('0') << unsigned(IR) << " : " << std::dec << unsigned(instruction_cycles) << " : ";
-		std::cout << opcodes[IR].mnemonic << " (" << addressing_modes[(int)opcodes[IR].addressing_mode].description << ")" << std::endl;
+		data_in = bus->Read(address);
+		*D0_D7 = data_in;
+	}
+
+	if (trace && stp == false && wai == false)
+	{
+		std::cout << "W65C816S::Cycle() : ";
+		std::cout << std::hex << std::setw(2) << std::setfill('0') << unsigned(PC.b16_23) << "/" << std::setw(4) << PC.db0_15;
+		std::cout << " => " << std::hex << std::setw(2) << std::setfill('0') << unsigned(data_in);
+		std::cout << " <= " << std::hex << std::setw(2) << std::setfill('0') << unsigned(data_out);
+		std::cout << " RWB=" << unsigned(*RWB);
+		std::cout << std::endl;
+	}
+
+	Clock();
+}
+
+uint64_t W65C816S::RunCycles(uint64_t cycles)
+{
+	// Cycle budget from the master clock, returns the cycles run
+
+	for (uint64_t i = 0; i < cycles; i++)
+		Cycle();
+
+	return cycles;
+}
+
+uint64_t W65C816S::RunUntil(uint64_t end, const uint64_t& next_event)
+{
+	// Runs freely until the clock count reaches end or the next scheduler event, which a bus
+	// access in the middle of the run may bring forward. Returns the cycles run.
+
+	uint64_t start = clock_count;
+
+	while (clock_count < end && clock_count < next_event)
+	{
+		// Nothing but an interrupt line, reset or an event can end WAI or STP, so the time up to
+		// the next event passes in one step
+
+		if (Idle())
+		{
+			uint64_t until = std::min(end, next_event);
+
+			idle_count += until - clock_count;
+			clock_count = until;
+			break;
+		}
+
+		if (instruction_cycles == 0 && !trace)
+		{
+			SkipLoop(std::min(end, next_event));
+
+			if (clock_count >= end || clock_count >= next_event)
+				break;
+		}
+
+		Cycle();
+	}
+
+	return clock_count - start;
+}
+
+bool W65C816S::Idle()
+{
+	// True when a Cycle would only count the clock
+
+	if (*RESB == 0b0 || reset_low)
+		return false;
+
+	return stp || (wai && *IRQB != 0b0 && *NMIB != 0b0);
+}
+
+bool W65C816S::LoopSafe(uint8_t opcode)
+{
+	// Instructions that only touch X, Y and the flags, and whose effect does not depend on the flags
+
+	void (W65C816S::*function)(void*) = opcodes[opcode].function;
+
+	return function == &W65C816S::INX || function == &W65C816S::INY || function == &W65C816S::DEX || function == &W65C816S::DEY ||
+		function == &W65C816S::CLC || function == &W65C816S::SEC || function == &W65C816S::JMP;
+}
+
+void W65C816S::SkipLoop(uint64_t until)
+{
+	// Called on instruction boundaries, address_out holds the address of the next opcode and IR
+	// the instruction that just ended
+
+	uint32_t pc = address_out.tb0_23;
+
+	if (*RESB == 0b0 || reset_low)
+	{
+		loop.head = Loop::NONE;
+		return;
+	}
+
+	if (pc == loop.head && clock_count == loop.start)
+		return;
 
-		if (opcodes[IR].function != nullptr)
-			(this->*(opcodes[IR].function))((void*)&opcodes[IR]);
+	bool wide = !GetX();
+	int32_t offset[2];
+
+	offset[0] = wide ? (int16_t)(X.db0_15 - loop.x) : (int8_t)(X.b0_7 - (uint8_t)loop.x);
+	offset[1] = wide ? (int16_t)(Y.db0_15 - loop.y) : (int8_t)(Y.b0_7 - (uint8_t)loop.y);
+
+	loop.pure = loop.pure && LoopSafe(IR) && bus->Passive(loop.last) && bus->Passive(loop.last + 3);
+
+	for (int i = 0; i < 2; i++)
+	{
+		loop.low[i] = std::min(loop.low[i], offset[i]);
+		loop.high[i] = std::max(loop.high[i], offset[i]);
+	}
+
+	if (pc == loop.head)
+	{
+		bool steady = false;
+
+		if (loop.pure && P == loop.p)
+		{
+			uint64_t cycles = clock_count - loop.start;
+
+			steady = cycles == loop.cycles && offset[0] == loop.delta[0] && offset[1] == loop.delta[1];
+
+			loop.cycles = cycles;
+			loop.delta[0] = offset[0];
+			loop.delta[1] = offset[1];
+		}
 		else
-			std::cout << "function not defined" << std::endl;
+			loop.cycles = 0;
+
+		if (steady)
+		{
+			// Whole iterations up to the next event, while no register crosses zero or its sign
+			// bit the flags come out of every iteration as they did from this one
 
+			uint64_t iterations = (until - clock_count) / loop.cycles;
+
+			iterations = std::min(iterations, LoopBound(X.db0_15, loop.delta[0], loop.low[0], loop.high[0], wide));
+			iterations = std::min(iterations, LoopBound(Y.db0_15, loop.delta[1], loop.low[1], loop.high[1], wide));
+
+			if (iterations > 0)
+			{
+				if (wide)
+				{
+					X.db0_15 = (uint16_t)(X.db0_15 + iterations * loop.delta[0]);
+					Y.db0_15 = (uint16_t)(Y.db0_15 + iterations * loop.delta[1]);
+				}
+				else
+				{
+					X.b0_7 = (uint8_t)(X.b0_7 + iterations * loop.delta[0]);
+					Y.b0_7 = (uint8_t)(Y.b0_7 + iterations * loop.delta[1]);
+				}
+
+				instruction_count += iterations * (instruction_count - loop.instructions);
+				clock_count += iterations * loop.cycles;
+				loop_count += iterations * loop.cycles;
+			}
+		}
+	}
+	else if (pc <= loop.last)
+	{
+		loop.head = pc;
+		loop.cycles = 0;
 	}
+	else
+	{
+		loop.last = pc;
+		return;
+	}
+
+	// A new iteration starts at the head
+
+	loop.last = pc;
+	loop.start = clock_count;
+	loop.instructions = instruction_count;
+	loop.x = X.db0_15;
+	loop.y = Y.db0_15;
+	loop.p = P;
+	loop.low[0] = loop.low[1] = 0;
+	loop.high[0] = loop.high[1] = 0;
+	loop.pure = true;
+}
+
+uint64_t W65C816S::LoopBound(uint16_t value, int32_t delta, int32_t low, int32_t high, bool wide)
+{
+	// Iterations a register changing by delta each time can run without leaving zero, the
+	// positive or the negative range, given its excursion from low to high within an iteration
+
+	if (delta == 0)
+		return UINT64_MAX;
+
+	int64_t size = wide ? 0x10000 : 0x100;
+	int64_t v = wide ? value : (value & 0xff);
+
+	if (v == 0)
+		return 0;
+
+	int64_t first = (v < size / 2) ? 1 : size / 2;
+	int64_t last = (v < size / 2) ? size / 2 - 1 : size - 1;
+
+	if (v + low < first || v + high > last)
+		return 0;
+
+	if (delta > 0)
+		return (uint64_t)((last - v - high) / delta) + 1;
+
+	return (uint64_t)((v + low - first) / -delta) + 1;
+}
+
+uint64_t W65C816S::GetClockCount()
+{
+	return clock_count;
+}
+
+uint64_t W65C816S::GetInstructionCount()
+{
+	return instruction_count;
+}
+
+uint64_t W65C816S::GetIdleCount()
+{
+	return idle_count;
+}
+
+uint64_t W65C816S::GetLoopCount()
+{
+	return loop_count;
+}
+
+void W65C816S::SetTrace(bool trace)
+{
+	this->trace = trace;
+}
+
+void W65C816S::SaveState(State& state)
+{
+	// Registers and the sequencing of the instruction in flight, the pins are bus lines
+
+	state.Begin("CPU ");
+
+	state.Put8((uint8_t)mode);
+	state.Put32(address_out.tb0_23 & 0xffffff);
+	state.Put8(data_in);
+	state.Put8(data_out);
+	state.Put16(immediate_data.db0_15);
+	state.Put8(IR);
+	state.Put8(P);
+	state.Put8(EP);
+	state.Put16(TCU.db0_15);
+	state.Put16(ALU.db0_15);
+	state.Put16(A.db0_15);
+	state.Put16(X.db0_15);
+	state.Put16(Y.db0_15);
+	state.Put32(DBR.tb0_23 & 0xffffff);
+	state.Put32(D.tb0_23 & 0xffffff);
+	state.Put32(PC.tb0_23 & 0xffffff);
+	state.Put32(S.tb0_23 & 0xffffff);
+
+	state.Put8(instruction_cycles);
+	state.Put32(reset_low_cycles);
+	state.Put8(reset_low);
+	state.Put8(stp);
+	state.Put8(wai);
+
+	state.Put64(clock_count);
+	state.Put64(instruction_count);
+	state.Put64(idle_count);
+	state.Put64(loop_count);
+
+	// The loop tracker too, so a resumed machine skips exactly where the original would have
+
+	state.Put32(loop.head);
+	state.Put32(loop.last);
+	state.Put64(loop.start);
+	state.Put64(loop.instructions);
+	state.Put16(loop.x);
+	state.Put16(loop.y);
+	state.Put8(loop.p);
+	state.Put8(loop.pure);
+	state.Put64(loop.cycles);
+
+	for (int i = 0; i < 2; i++)
+	{
+		state.Put32(loop.low[i]);
+		state.Put32(loop.high[i]);
+		state.Put32(loop.delta[i]);
+	}
+
+	state.End();
+}
+
+bool W65C816S::LoadState(State& state)
+{
+	if (!state.Find("CPU "))
+		return false;
+
+	uint8_t loaded_mode = state.Get8();
+
+	if (loaded_mode != (uint8_t)MODE::NATIVE && loaded_mode != (uint8_t)MODE::EMULATION)
+		return false;
+
+	mode = (MODE)loaded_mode;
+	address_out.tb0_23 = state.Get32();
+	data_in = state.Get8();
+	data_out = state.Get8();
+	immediate_data.db0_15 = state.Get16();
+	IR = state.Get8();
+	P = state.Get8();
+	EP = state.Get8();
+	TCU.db0_15 = state.Get16();
+	ALU.db0_15 = state.Get16();
+	A.db0_15 = state.Get16();
+	X.db0_15 = state.Get16();
+	Y.db0_15 = state.Get16();
+	DBR.tb0_23 = state.Get32();
+	D.tb0_23 = state.Get32();
+	PC.tb0_23 = state.Get32();
+	S.tb0_23 = state.Get32();
+
+	instruction_cycles = state.Get8();
+	reset_low_cycles = state.Get32();
+	reset_low = state.Get8() != 0;
+	stp = state.Get8() != 0;
+	wai = state.Get8() != 0;
+
+	clock_count = state.Get64();
+	instruction_count = state.Get64();
+	idle_count = state.Get64();
+	loop_count = state.Get64();
+
+	loop.head = state.Get32();
+	loop.last = state.Get32();
+	loop.start = state.Get64();
+	loop.instructions = state.Get64();
+	loop.x = state.Get16();
+	loop.y = state.Get16();
+	loop.p = state.Get8();
+	loop.pure = state.Get8() != 0;
+	loop.cycles = state.Get64();
+
+	for (int i = 0; i < 2; i++)
+	{
+		loop.low[i] = (int32_t)state.Get32();
+		loop.high[i] = (int32_t)state.Get32();
+		loop.delta[i] = (int32_t)state.Get32();
+	}
+
+	return !state.GetFailed();
 }
 
 void W65C816S::Run()
@@ -196,7 +583,7 @@ void W65C816S::Run()
 			}
 		}
 
-		if (stp == false && wai == false)
+		if (trace && stp == false && wai == false)
 		{
 			std::cout << "W65C816S::Run() : ";
 			std::cout << std::hex << std::setw(2) << std::setfill('0') << unsigned(PC.b16_23) << "/" << std::setw(4) << PC.db0_15;
@@ -229,7 +616,7 @@ void W65C816S::Stop()
 		thread_run.join();
 }
 
-void W65C816S::Debug()
+std::string W65C816S::Debug()
 {
 	using namespace std;
 
@@ -243,12 +630,29 @@ void W65C816S::Debug()
 	stringStream << "X  : " << dec << setw(5) << setfill(' ') << X.db0_15 << " 0x" << hex << setw(4) << setfill('0') << X.db0_15 << " \t";
 	stringStream << "Y  : " << dec << setw(5) << setfill(' ') << Y.db0_15 << " 0x" << hex << setw(4) << setfill('0') << Y.db0_15 << " \t";
 
-	system->DrawString(9, 9 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 7 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(9, 7 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 9 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(7, 8 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(9, 8 + (9 * 8), stringStream.str(), olc::BLACK, 1);
-	system->DrawString(8, 8 + (9 * 8), stringStream.str(), olc::WHITE, 1);
+	return stringStream.str();
+}
+
+std::string W65C816S::Registers()
+{
+	// Every programmer visible register on one line, for logs and comparing runs
+
+	using namespace std;
+
+	ostringstream stringStream;
+
+	stringStream << hex << setfill('0');
+	stringStream << "PC=" << setw(2) << unsigned(PC.b16_23) << ":" << setw(4) << PC.db0_15;
+	stringStream << " A=" << setw(4) << A.db0_15;
+	stringStream << " X=" << setw(4) << X.db0_15;
+	stringStream << " Y=" << setw(4) << Y.db0_15;
+	stringStream << " S=" << setw(4) << S.db0_15;
+	stringStream << " D=" << setw(4) << D.db0_15;
+	stringStream << " DBR=" << setw(2) << unsigned(DBR.b16_23);
+	stringStream << " P=" << setw(2) << unsigned(P);
+	stringStream << " E=" << (GetE() ? 1 : 0);
+	stringStream << dec << " cycles=" << clock_count << " instructions=" << instruction_count;
+
+	return stringStream.str();
 }
 
@@ -2,9 +2,10 @@
 
 #include <string>
 #include <thread>
+#include <algorithm>
 
 #include "bus.h"
-#include "olcPixelGameEngine.h"
+#include "state.h"
 
 class W65C816S {
 public:
@@ -341,7 +342,7 @@ public:
 		{ "INY", ADDRESSINGMODES::implied, 2, 1, &W65C816S::INY },
 		{ "ORA", ADDRESSINGMODES::absolute_indexed_with_y, 4, 3, nullptr },
 		{ "DEX", ADDRESSINGMODES::implied, 2, 1, &W65C816S::DEX },
-		{ "TCS", ADDRESSINGMODES::implied, 2, 1, nullptr },
+		{ "WAI", ADDRESSINGMODES::implied, 3, 1, &W65C816S::WAI },
 		{ "TRB", ADDRESSINGMODES::absolute, 6, 3, nullptr },
 		{ "ORA", ADDRESSINGMODES::absolute_indexed_with_x, 4, 3, nullptr },
 		{ "ASL", ADDRESSINGMODES::absolute_indexed_with_x, 7, 3, nullptr },
@@ -445,7 +446,6 @@ public:
 
 private:
 	Bus::SharedPtr bus;
-	olc::PixelGameEngine* system;
 	bool running;
 
 	MODE mode;
@@ -497,12 +497,40 @@ private:
 	bool stp, wai;
 
 	uint64_t clock_count;
+	uint64_t instruction_count;
+	uint64_t idle_count;		// cycles skipped in WAI or STP
+	uint64_t loop_count;		// cycles fast-forwarded through idle loops
 	std::thread thread_run;
 
+	// A backward jump starts an iteration at its target. An iteration that runs only register
+	// instructions fetched from passive memory, and repeats the length and register change of the
+	// one before, is a steady loop that can be advanced a whole number of iterations at once.
+
+	class Loop {
+	public:
+		static const uint32_t NONE = 0xffffffff;
+
+		uint32_t head;			// address of the first instruction, NONE when not tracking
+		uint32_t last;			// address of the previous instruction
+		uint64_t start;			// clock count the iteration started on
+		uint64_t instructions;	// instruction count the iteration started on
+		uint16_t x, y;			// index registers at the start of the iteration
+		uint8_t p;
+		int32_t low[2];			// X and Y excursion from the start within the iteration
+		int32_t high[2];
+		bool pure;
+		uint64_t cycles;		// length of the last iteration, 0 until one completed
+		int32_t delta[2];		// X and Y change over the last iteration
+	};
+
+	Loop loop;
+
+	bool trace;		// log every cycle and instruction to std::cout
+
 protected:
 
 public:
-	W65C816S(Bus::SharedPtr bus, olc::PixelGameEngine* system);
+	W65C816S(Bus::SharedPtr bus);
 	~W65C816S();
 
 	// Status register functions
@@ -552,14 +580,31 @@ public:
 	void Reset();
 
 	void Clock();
+	void Cycle();
+	uint64_t RunCycles(uint64_t cycles);
+	uint64_t RunUntil(uint64_t end, const uint64_t& next_event);
+	uint64_t GetClockCount();
+	uint64_t GetInstructionCount();
+	uint64_t GetIdleCount();
+	uint64_t GetLoopCount();
+	bool Idle();
+	bool LoopSafe(uint8_t opcode);
+	void SkipLoop(uint64_t until);
+	static uint64_t LoopBound(uint16_t value, int32_t delta, int32_t low, int32_t high, bool wide);
 
 	void Run();
 	void Start();
 	void Stop();
 
+	void SetTrace(bool trace);
+
+	void SaveState(State& state);
+	bool LoadState(State& state);
+
 	// Debug functions
 
-	void W65C816S::Debug();
+	std::string W65C816S::Debug();
+	std::string Registers();
 
 	// Bus in/out function helper
 